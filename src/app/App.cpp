@@ -32,6 +32,7 @@ void App::loop() {
     M5.update();
     if (M5.BtnA.wasPressed()) _onButtonA();
 
+    _meter->loop();
     _server->loop();
 
     delay(50);
@@ -7,28 +7,119 @@
 #include "app/AppMeter.h"
 #include "lib/spiffs.h"
 #include "lib/utils.h"
-#include "lib/wisun/BP35A.h"
-#include "lib/wisun/BP35C.h"
+#include "lib/wisun/detect.h"
+
+#if !defined(MEASURE_RETRY_INTERVAL)
+#define MEASURE_RETRY_INTERVAL 5
+#endif
 
 void AppMeter::setup() {
-    xTaskCreatePinnedToCore(
-            [](void *arg) {
-                auto *self = (AppMeter *) arg;
-                self->_setup();
-#pragma clang diagnostic push
-#pragma ide diagnostic ignored "EndlessLoop"
-                while (true) {
-                    self->_loop();
-                }
-#pragma clang diagnostic pop
-            },
-            "AppMeter",
-            8192,
-            this,
-            1,
-            &_taskHandle,
-            APP_CPU_NUM
+#if defined(MQTT_ENABLE)
+    _mqtt = std::make_unique<Mqtt>(
+            MQTT_HOST, MQTT_PORT, MQTT_CLIENT_ID,
+            spiffsLoadString(MQTT_CA_CERTIFICATE_PATH),
+            spiffsLoadString(MQTT_CERTIFICATE_PATH),
+            spiffsLoadString(MQTT_PRIVATE_KEY_PATH)
     );
+    if (!_mqtt->connect()) {
+        Serial.println("ERROR: Failed to connect to MQTT server. Rebooting...");
+        delay(5000);
+        ESP.restart();
+    }
+#endif // defined(MQTT_ENABLE)
+
+#if defined(WISUN_MODULE)
+    auto wisun = wisunCreate(WISUN_MODULE, Serial2);
+#else
+    auto wisun = wisunDetect(Serial2);
+    if (wisun == nullptr) {
+        Serial.println("ERROR: Wi-SUN module not found. Rebooting...");
+        delay(5000);
+        ESP.restart();
+    }
+#endif // defined(WISUN_MODULE)
+#if defined(WISUN_BAUD_RATE)
+    wisun->setBaudRate(WISUN_BAUD_RATE);
+#endif // defined(WISUN_BAUD_RATE)
+    _smartMeter = std::make_unique<SmartMeterClient>(std::move(wisun), BROUTE_ID, BROUTE_PASSWORD);
+#if !defined(RETRANSMIT_MAX_ATTEMPTS)
+#define RETRANSMIT_MAX_ATTEMPTS 3
+#endif
+#if !defined(RETRANSMIT_MAX_INTERVAL)
+#define RETRANSMIT_MAX_INTERVAL 8000
+#endif
+    _smartMeter->setRetransmission(RETRANSMIT_MAX_ATTEMPTS, RETRANSMIT_MAX_INTERVAL);
+    _smartMeter->setNotificationListener([&](const MeterValue &value) { _onNotified(value); });
+    // connect on the I/O task
+    _smartMeter->begin();
+}
+
+/**
+ * Drive measurement and history (main loop)
+ *
+ * Requests are handed to the I/O task of SmartMeterClient and their results are polled without blocking.
+ */
+void AppMeter::loop() {
+#if defined(MQTT_ENABLE)
+    // keep MQTT alive even while joining to the meter
+    _mqtt->dispatch();
+#endif // defined(MQTT_ENABLE)
+
+    switch (_smartMeter->getState()) {
+        case SmartMeterClient::STATE_CONNECTED:
+            if (_shownJoinPhase != WiSUN::JOIN_PHASE_NONE) {
+                // remove join progress
+                _shownJoinPhase = WiSUN::JOIN_PHASE_NONE;
+                xSemaphoreTake(_lock, portMAX_DELAY);
+                _updateDisplay();
+                xSemaphoreGive(_lock);
+            }
+            break;
+        case SmartMeterClient::STATE_FAILED:
+            Serial.println("ERROR: Failed to recover the link to the smart meter. Rebooting...");
+            // the module may have been replaced
+            wisunForgetDetected();
+            delay(5000);
+            ESP.restart();
+            return;
+        default:
+            // keep showing cached data with join progress
+            if (_updateJoinProgress()) {
+                xSemaphoreTake(_lock, portMAX_DELAY);
+                _updateDisplay();
+                xSemaphoreGive(_lock);
+            }
+            return;
+    }
+
+    auto changed = _measure();
+    changed = _updateHistory() || changed;
+    changed = _notified.exchange(false) || changed;
+    if (changed) {
+        xSemaphoreTake(_lock, portMAX_DELAY);
+        _updateDisplay();
+        xSemaphoreGive(_lock);
+    }
+}
+
+/**
+ * Follow join progress reported by the I/O task
+ *
+ * @return true:changed
+ */
+bool AppMeter::_updateJoinProgress() {
+    auto phase = _smartMeter->getJoinPhase();
+    auto steps = _smartMeter->getJoinSteps();
+    if (phase == WiSUN::JOIN_PHASE_NONE) {
+        // not started yet
+        phase = WiSUN::JOIN_PHASE_INITIALIZING;
+    }
+    if (phase == _shownJoinPhase && steps == _shownJoinSteps) {
+        return false;
+    }
+    _shownJoinPhase = phase;
+    _shownJoinSteps = steps;
+    return true;
 }
 
 /**
@@ -59,6 +150,10 @@ std::vector<MeterValue> AppMeter::getHistory() {
     return ret;
 }
 
+LinkQuality::Stats AppMeter::getLinkStats() {
+    return _smartMeter->getLinkStats();
+}
+
 void showDateTime(time_t now) {
     struct tm tm{};
     if (localtime_r(&now, &tm)) {
@@ -70,16 +165,18 @@ void showDateTime(time_t now) {
     }
 }
 
-void showCurrent(uint32_t value) {
+void showCurrent(int32_t value) {
     if (value > 9999) {
         value = 9999;
+    } else if (value < -999) {
+        value = -999;
     }
     M5.Display.setTextSize(3);
     M5.Display.setCursor(144, 32);
-    M5.Display.printf("%4u", value);
+    M5.Display.printf("%4d", value);
     M5.Display.setTextSize(2);
     M5.Display.setCursor(220, 40);
-    M5.Display.print("W");
+    M5.Display.print(SmartMeterInstantaneousPower::getUnit());
 }
 
 void showIntegral(double value) {
@@ -88,7 +185,7 @@ void showIntegral(double value) {
     M5.Display.printf("%4.1f", value);
     M5.Display.setTextSize(2);
     M5.Display.setCursor(84, 40);
-    M5.Display.print("kWh");
+    M5.Display.print(SmartMeterCumulativeForward::getUnit());
 }
 
 void showCost(int value) {
@@ -104,20 +201,20 @@ void showHistory(const std::vector<MeterValue> &history, int sx, int sy, int wid
     int nX = 24 * 2 * 2; // 48H
     int w = static_cast<int>(width / nX);
 
-    std::vector<double> deltas;
+    std::vector<uint32_t> deltas;
     int start = std::max(0, (int) history.size() - nX - 1);
-    double prev = *history[start].getCumulative();
     for (int i = start + 1; i < history.size(); i++) {
-        double v = *history[i].getCumulative();
-        deltas.push_back(v - prev);
-        prev = v;
+        deltas.push_back(history[i].getCumulativeDelta(history[i - 1]));
+    }
+    if (deltas.empty()) {
+        return;
     }
-    double maxDelta = *std::max_element(deltas.begin(), deltas.end());
+    uint32_t maxDelta = std::max(1u, *std::max_element(deltas.begin(), deltas.end()));
 
     M5Canvas canvas(&M5.Display);
     canvas.createSprite(width, height);
     for (int i = 0; i < deltas.size(); i++) {
-        auto y = static_cast<int>((deltas[i] / maxDelta) * (double) height);
+        auto y = static_cast<int>((uint64_t) deltas[i] * height / maxDelta);
         canvas.fillRect(i * w, height - y, w, y, TFT_WHITE);
     }
     M5.Display.startWrite();
@@ -125,195 +222,335 @@ void showHistory(const std::vector<MeterValue> &history, int sx, int sy, int wid
     M5.Display.endWrite();
 }
 
-void AppMeter::_setup() {
-#if defined(MQTT_ENABLE)
-    _mqtt = std::make_unique<Mqtt>(
-            MQTT_HOST, MQTT_PORT, MQTT_CLIENT_ID,
-            spiffsLoadString(MQTT_CA_CERTIFICATE_PATH),
-            spiffsLoadString(MQTT_CERTIFICATE_PATH),
-            spiffsLoadString(MQTT_PRIVATE_KEY_PATH)
-    );
-    if (!_mqtt->connect()) {
-        Serial.println("ERROR: Failed to connect to MQTT server. Rebooting...");
-        delay(5000);
-        ESP.restart();
+const char *joinPhaseLabel(WiSUN::JoinPhase phase) {
+    switch (phase) {
+        case WiSUN::JOIN_PHASE_INITIALIZING:
+            return "Initializing";
+        case WiSUN::JOIN_PHASE_SCANNING:
+            return "Scanning";
+        case WiSUN::JOIN_PHASE_CONNECTING:
+            return "Connecting";
+        case WiSUN::JOIN_PHASE_SUCCEEDED:
+            return "Connected";
+        case WiSUN::JOIN_PHASE_FAILED:
+            return "Failed";
+        default:
+            return "";
     }
-#endif // defined(MQTT_ENABLE)
+}
 
-    std::unique_ptr<WiSUN> wisun;
-    if (strcmp(WISUN_MODULE, "BP35C") == 0) {
-        wisun = std::make_unique<BP35C>(Serial2, 36, 0);
-    } else {
-        // rxPin: Wi-SUN HAT rev 0.1 の場合は 36 にする
-        wisun = std::make_unique<BP35A>(Serial2, 26, 0);
-    }
-    _smartMeter = std::make_unique<SmartMeterClient>(std::move(wisun), BROUTE_ID, BROUTE_PASSWORD);
-    if (!_smartMeter->connect()) {
-        Serial.println("ERROR: Failed to connect to the smart meter. Rebooting...");
-        delay(5000);
-        ESP.restart();
+void showJoinProgress(WiSUN::JoinPhase phase, int steps) {
+    M5.Display.fillScreen(BLACK);
+    M5.Display.setTextSize(2);
+    M5.Display.setCursor(0, 0);
+    M5.Display.print(joinPhaseLabel(phase));
+    for (int i = 0; i < steps; i++) {
+        M5.Display.print(".");
     }
 }
 
-void AppMeter::_loop() {
-    auto changed = _measure() || _updateHistory();
-    if (changed) {
-        xSemaphoreTake(_lock, portMAX_DELAY);
-        _updateDisplay();
-        xSemaphoreGive(_lock);
-    }
-    delay(200);
+void showJoinStatus(WiSUN::JoinPhase phase) {
+    M5.Display.setTextSize(1);
+    M5.Display.setCursor(8, 124);
+    M5.Display.printf("%s...", joinPhaseLabel(phase));
 }
 
 /**
- * Update display
+ * Update display (main loop)
+ *
+ * While joining, join progress is shown in place of the values, or over the cached values if any.
  */
 void AppMeter::_updateDisplay() {
+    bool joining = _shownJoinPhase != WiSUN::JOIN_PHASE_NONE;
+    if (_measured == nullptr) {
+        if (joining) {
+            showJoinProgress(_shownJoinPhase, _shownJoinSteps);
+        }
+        return;
+    }
     M5.Display.fillScreen(BLACK);
     showDateTime(_measured->getTimestamp());
-    auto instantaneous = _measured->getInstantaneous();
-    if (instantaneous != nullptr) {
-        showCurrent(*instantaneous);
+    if (_measured->hasInstantaneous()) {
+        showCurrent(_measured->getInstantaneous());
     }
-    auto usage = _getUsageToday();
-    if (usage != nullptr) {
+    double usage;
+    if (_getUsageToday(usage)) {
         if (_displayMode == DISPLAY_MODE_COST) {
-            showCost(static_cast<int>(*usage * PRICE_YEN_PER_KWH));
+            showCost(static_cast<int>(usage * PRICE_YEN_PER_KWH));
         } else {
-            showIntegral(*usage);
+            showIntegral(usage);
         }
     }
     if (!_meterHistory.empty()) {
         showHistory(_meterHistory, 24, 80, 232, 40);
     }
+    if (joining) {
+        showJoinStatus(_shownJoinPhase);
+    }
 }
 
 /**
  * Get history
  */
-std::unique_ptr<MeterValue> AppMeter::_getHistory(time_t timestamp) {
+const MeterValue *AppMeter::_getHistory(time_t timestamp) {
     for (const auto &h: _meterHistory) {
         if (h.getTimestamp() == timestamp) {
-            return std::make_unique<MeterValue>(h);
+            return &h;
         }
     }
     return nullptr;
 }
 
 /**
- * Get today's usage (kWh)
+ * Get today's usage
+ *
+ * @param kwh usage (kWh)
+ * @return true:success, false:not available
  */
-std::unique_ptr<double> AppMeter::_getUsageToday() {
+bool AppMeter::_getUsageToday(double &kwh) {
     auto now = time(nullptr);
     struct tm tm{};
     if (!localtime_r(&now, &tm)) {
-        return nullptr;
+        return false;
     }
     tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
     time_t timestamp = mktime(&tm);
     auto begin = _getHistory(timestamp);
-    if (_measured == nullptr || _measured->getCumulative() == nullptr ||
-        begin == nullptr || begin->getCumulative() == nullptr) {
-        return nullptr;
+    if (_measured == nullptr || !_measured->hasCumulative() || begin == nullptr || !begin->hasCumulative()) {
+        return false;
     }
-    auto kwh = *_measured->getCumulative() - *begin->getCumulative();
-    return std::make_unique<double>(kwh);
+    kwh = _measured->getScale().apply<SmartMeterCumulativeForward>(_measured->getCumulativeDelta(*begin));
+    return true;
 }
 
 /**
  * Measure
+ *
+ * @return true:measurement completed
  */
 bool AppMeter::_measure() {
+    if (_measuring.isValid()) {
+        if (!_measuring.isReady()) {
+            return false;
+        }
+        _onMeasured(_measuring.take(), _measuring.getError(), _measureRequestTime);
+        _measuring.reset();
+        return true;
+    }
     auto now = time(nullptr);
-    if (_lastMeasureTime == 0 || _lastMeasureTime + MEASURE_INTERVAL < now) {
-        auto measured = _smartMeter->getMeterValue();
-        if (measured == nullptr) {
-            delay(1000);
-            this->_failure++;
-            // Restart when failed to get repeatedly
-            if (this->_failure > 4) {
-                Serial.println("err");
-                Serial.flush();
-                ESP.restart();
-            }
-            Serial.println("Retrying");
-            return true;
+    if (_isMeasureDue(now)) {
+        _measuring = _smartMeter->getMeterValueAsync();
+        _measureRequestTime = now;
+    }
+    return false;
+}
+
+/**
+ * Check if measurement is due
+ */
+bool AppMeter::_isMeasureDue(time_t now) const {
+    return _lastMeasureTime == 0 || _lastMeasureTime + MEASURE_INTERVAL < now;
+}
+
+/**
+ * Handle measured value
+ *
+ * @param measured measured value (nullptr:failure)
+ * @param error error of the request
+ * @param now requested time
+ */
+void AppMeter::_onMeasured(std::unique_ptr<MeterValue> measured, const SmartMeterError &error, time_t now) {
+    if (measured == nullptr) {
+        Serial.printf("Failed to measure: %s\n", error.toString().c_str());
+        if (error.isRefused()) {
+            // The meter is reachable: retry at the next interval
+            _lastMeasureTime = now;
+            return;
         }
-        this->_failure = 0;
+        // The link is recovered by SmartMeterClient: retry before the next interval, but not at the loop rate
+        // (BUSY or an invalid response fails immediately)
+        Serial.printf("Retrying in %d seconds\n", MEASURE_RETRY_INTERVAL);
+        _lastMeasureTime = now - MEASURE_INTERVAL + std::min(MEASURE_RETRY_INTERVAL, MEASURE_INTERVAL);
+        return;
+    }
 
-        xSemaphoreTake(_lock, portMAX_DELAY);
-        _measured = std::move(measured);
-        xSemaphoreGive(_lock);
-        _lastMeasureTime = now;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _measured = std::move(measured);
+    xSemaphoreGive(_lock);
+    _lastMeasureTime = now;
 
 #if defined(MQTT_ENABLE)
-        _publishMeasured();
+    _publishMeasured();
 #endif // defined(MQTT_ENABLE)
+}
 
-        return true;
+/**
+ * Handle value notified by the meter
+ *
+ * 定時積算電力量 is taken as a history entry and 瞬時電力 updates the latest value
+ * (keeping the last measured cumulative).
+ *
+ * @param value notified value
+ */
+void AppMeter::_onNotified(const MeterValue &value) {
+    if (!value.hasInstantaneous()) {
+        if ((value.hasCumulative() || value.hasCumulativeReverse()) && _appendHistory({value})) {
+            _notified = true;
+        }
+        return;
     }
-    return false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    if (_measured != nullptr) {
+        auto measured = std::make_unique<MeterValue>(value.getTimestamp());
+        measured->setInstantaneous(value.getInstantaneous());
+        if (_measured->hasCumulative()) {
+            measured->setCumulative(_measured->getCumulative(), _measured->getScale());
+        }
+        if (_measured->hasCumulativeReverse()) {
+            measured->setCumulativeReverse(_measured->getCumulativeReverse(), _measured->getScale());
+        }
+        _measured = std::move(measured);
+        _notified = true;
+    }
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Append history entries newer than the last one
+ *
+ * 逆方向 notified separately is merged into the last entry of the same time.
+ *
+ * @param history history (oldest first)
+ * @return true:appended, false:no new entry
+ */
+bool AppMeter::_appendHistory(const std::vector<MeterValue> &history) {
+    bool appended = false;
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    for (const auto &v: history) {
+        if (!_meterHistory.empty() && _lastHistoryTime == v.getTimestamp()) {
+            auto &last = _meterHistory.back();
+            if (v.hasCumulativeReverse() && !last.hasCumulativeReverse()) {
+                last.setCumulativeReverse(v.getCumulativeReverse(), v.getScale());
+                appended = true;
+            }
+        } else if (_lastHistoryTime < v.getTimestamp() && v.hasCumulative()) {
+            _meterHistory.push_back(v);
+            _lastHistoryTime = v.getTimestamp();
+            if (_meterHistory.size() > 48 * 3) {  // max: 3 days
+                _meterHistory.erase(_meterHistory.begin());
+            }
+            appended = true;
+        }
+    }
+    xSemaphoreGive(_lock);
+    return appended;
+}
+
+/**
+ * Get the time of the latest 30-minute boundary
+ */
+time_t AppMeter::_getLatestSlotTime(time_t now) {
+    struct tm tm{};
+    localtime_r(&now, &tm);
+    tm.tm_min = tm.tm_min < 30 ? 0 : 30;
+    tm.tm_sec = 0;
+    return mktime(&tm);
 }
 
 /**
  * Update history
+ *
+ * @return true:history updated or published
  */
 bool AppMeter::_updateHistory() {
+    if (_fetchingHistory.isValid()) {
+        return _fetchingHistory.isReady() && _onHistoryFetched();
+    }
+
     auto now = time(nullptr);
-    bool needPublish = false;
-
-    // get history for last 3 days
-    if (_lastHistoryTime == 0 || _lastHistoryTime + 35 * 60 < now) {
-        for (int i = _lastHistoryTime == 0 ? 3 : 0; i >= 0; i--) {
-            auto history = _smartMeter->getMeterHistory(i);
-            if (history != nullptr) {
-                for (const auto &v: *history) {
-                    if (_lastHistoryTime < v.getTimestamp()) {
-                        _meterHistory.push_back(v);
-                        _lastHistoryTime = v.getTimestamp();
-                        if (_meterHistory.size() > 48 * 3) {  // max: 3 days
-                            _meterHistory.erase(_meterHistory.begin());
-                        }
-                    }
-                }
-            }
-        }
-#if 1 // DEBUG: Log _meterHistory
-        for (const auto &v: _meterHistory) {
-            auto t = v.getTimestamp();
-            struct tm tm{};
-            if (!localtime_r(&t, &tm)) {
-                continue;
-            }
-            std::stringstream ss;
-            ss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
-            Serial.printf("%s: %d\n", ss.str().c_str(), *v.getCumulative());
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    auto lastHistoryTime = _lastHistoryTime;
+    auto hasHistory = !_meterHistory.empty();
+    xSemaphoreGive(_lock);
+
+    if (lastHistoryTime == 0 || lastHistoryTime + 35 * 60 < now) {
+        // get only the missing slots
+        auto latest = _getLatestSlotTime(now);
+        auto missing = (int) ((latest - lastHistoryTime) / 1800);
+        if (lastHistoryTime != 0 && missing > 0 && missing <= 12) {
+            _fetchingHistoryDay = -1;
+            _fetchingHistory = _smartMeter->getMeterHistory2Async(latest, missing);
+        } else {
+            // get history for last 3 days
+            _fetchingHistoryDay = lastHistoryTime == 0 ? 3 : 0;
+            _fetchingHistory = _smartMeter->getMeterHistoryAsync(_fetchingHistoryDay);
         }
-#endif
-        needPublish = true;
-    } else if (!_meterHistory.empty() && _lastHistoryPublishTime + HISTORY_INTERVAL < now) {
-        needPublish = true;
+        return false;
     }
 
-    if (needPublish) {
+    if (hasHistory && _lastHistoryPublishTime + HISTORY_INTERVAL < now) {
 #if defined(MQTT_ENABLE)
         _publishHistory();
 #endif // defined(MQTT_ENABLE)
         _lastHistoryPublishTime = now;
         return true;
     }
-
     return false;
 }
 
+/**
+ * Handle fetched history and request the next day if any
+ *
+ * @return true:all requested history fetched
+ */
+bool AppMeter::_onHistoryFetched() {
+    auto history = _fetchingHistory.take();
+    _fetchingHistory.reset();
+    if (history != nullptr) {
+        _appendHistory(*history);
+    } else if (_fetchingHistoryDay < 0) {
+        // fall back to the history of today
+        _fetchingHistoryDay = 0;
+        _fetchingHistory = _smartMeter->getMeterHistoryAsync(_fetchingHistoryDay);
+        return false;
+    }
+    if (_fetchingHistoryDay > 0) {
+        _fetchingHistoryDay--;
+        _fetchingHistory = _smartMeter->getMeterHistoryAsync(_fetchingHistoryDay);
+        return false;
+    }
+
+    xSemaphoreTake(_lock, portMAX_DELAY);
+#if 1 // DEBUG: Log _meterHistory
+    for (const auto &v: _meterHistory) {
+        auto t = v.getTimestamp();
+        struct tm tm{};
+        if (!localtime_r(&t, &tm)) {
+            continue;
+        }
+        std::stringstream ss;
+        ss << std::put_time(&tm, "%Y-%m-%d %H:%M:%S");
+        Serial.printf("%s: %.1f\n", ss.str().c_str(), v.getCumulativeKwh());
+    }
+#endif
+    xSemaphoreGive(_lock);
+
+#if defined(MQTT_ENABLE)
+    _publishHistory();
+    _publishLinkStats();
+#endif // defined(MQTT_ENABLE)
+    _lastHistoryPublishTime = time(nullptr);
+    return true;
+}
+
 /**
  * Publish measured data
  */
 void AppMeter::_publishMeasured() {
     DynamicJsonDocument message{128};
-    message["timestamp"] = _measured->getTimestamp();
-    message["instantaneous"] = *_measured->getInstantaneous();
-    message["cumulative"] = *_measured->getCumulative();
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _measured->toJson(message.to<JsonObject>());
+    xSemaphoreGive(_lock);
 #if !defined(MQTT_TOPIC_MEASURED) && defined(MQTT_TOPIC)
 #define MQTT_TOPIC_MEASURED MQTT_TOPIC
 #endif
@@ -323,10 +560,21 @@ void AppMeter::_publishMeasured() {
 void AppMeter::_publishHistory() {
     DynamicJsonDocument message{8192};
     auto arr = message.to<JsonArray>();
+    xSemaphoreTake(_lock, portMAX_DELAY);
     for (const auto &v: _meterHistory) {
-        auto obj = arr.add();
-        obj["timestamp"] = v.getTimestamp();
-        obj["cumulative"] = *v.getCumulative();
+        v.toJson(arr.createNestedObject());
     }
+    xSemaphoreGive(_lock);
     _mqtt->publish(MQTT_TOPIC_HISTORY, jsonEncode(message));
 }
+
+/**
+ * Publish link quality statistics
+ */
+void AppMeter::_publishLinkStats() {
+#if defined(MQTT_TOPIC_LINK)
+    DynamicJsonDocument message{512};
+    getLinkStats().toJson(message.to<JsonObject>());
+    _mqtt->publish(MQTT_TOPIC_LINK, jsonEncode(message));
+#endif // defined(MQTT_TOPIC_LINK)
+}
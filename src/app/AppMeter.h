@@ -1,6 +1,8 @@
 #if !defined(APP_APP_METER_H)
 #define APP_APP_METER_H
 
+#include <atomic>
+
 #include "lib/Mqtt.h"
 #include "lib/SmartMeterClient.h"
 
@@ -14,31 +16,36 @@ public:
 
     void setup();
 
+    void loop();
+
     void toggleDisplayMode();
 
     std::unique_ptr<MeterValue> getLatest();
 
     std::vector<MeterValue> getHistory();
 
+    LinkQuality::Stats getLinkStats();
+
 private:
     std::unique_ptr<SmartMeterClient> _smartMeter;
 #if defined(MQTT_ENABLE)
     std::unique_ptr<Mqtt> _mqtt;
 #endif // defined(MQTT_ENABLE)
 
-    TaskHandle_t _taskHandle;
-
     SemaphoreHandle_t _lock = xSemaphoreCreateMutex();
 
     /// Display mode
     int _displayMode = 0;
 
-    /// Failed count
-    int _failure = 0;
-
     /// Last measured time
     time_t _lastMeasureTime = 0;
 
+    /// Outstanding measurement
+    SmartMeterFuture<MeterValue> _measuring;
+
+    /// Requested time of the outstanding measurement
+    time_t _measureRequestTime = 0;
+
     /// Meter History
     std::unique_ptr<MeterValue> _measured;
 
@@ -51,23 +58,48 @@ private:
     /// Meter History
     std::vector<MeterValue> _meterHistory;
 
-    void _setup();
+    /// Outstanding history request
+    SmartMeterFuture<std::vector<MeterValue>> _fetchingHistory;
+
+    /// Day of the outstanding 0xE2 history request (-1: 0xEC history request)
+    int _fetchingHistoryDay = 0;
+
+    /// Notified by the meter since the last display update (set by the I/O task)
+    std::atomic<bool> _notified{false};
 
-    void _loop();
+    /// Join progress on the display (JOIN_PHASE_NONE: connected)
+    WiSUN::JoinPhase _shownJoinPhase = WiSUN::JOIN_PHASE_NONE;
+    int _shownJoinSteps = 0;
+
+    bool _updateJoinProgress();
 
     void _updateDisplay();
 
-    std::unique_ptr<MeterValue> _getHistory(time_t timestamp);
+    const MeterValue *_getHistory(time_t timestamp);
 
-    std::unique_ptr<double> _getUsageToday();
+    bool _getUsageToday(double &kwh);
 
     bool _measure();
 
+    bool _isMeasureDue(time_t now) const;
+
+    void _onMeasured(std::unique_ptr<MeterValue> measured, const SmartMeterError &error, time_t now);
+
+    void _onNotified(const MeterValue &value);
+
+    bool _appendHistory(const std::vector<MeterValue> &history);
+
+    static time_t _getLatestSlotTime(time_t now);
+
     bool _updateHistory();
 
+    bool _onHistoryFetched();
+
     void _publishMeasured();
 
     void _publishHistory();
+
+    void _publishLinkStats();
 };
 
 #endif // !defined(APP_APP_METER_H)
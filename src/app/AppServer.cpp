@@ -13,6 +13,7 @@ void AppServer::setup() {
     _httpServer.on("/", [&] { _onRoot(); });
     _httpServer.on("/latest", [&] { _onLatest(); });
     _httpServer.on("/history", [&] { _onHistory(); });
+    _httpServer.on("/link", [&] { _onLink(); });
     _httpServer.onNotFound([&] { _onNotFound(); });
     _httpServer.begin();
 }
@@ -32,15 +33,7 @@ void AppServer::_onLatest() {
         return;
     }
     DynamicJsonDocument body(1024);
-    body["timestamp"] = data->getTimestamp();
-    auto instantaneous = data->getInstantaneous();
-    if (instantaneous != nullptr) {
-        body["instantaneous"] = *instantaneous;
-    }
-    auto cumulative = data->getCumulative();
-    if (cumulative != nullptr) {
-        body["cumulative"] = *cumulative;
-    }
+    data->toJson(body.to<JsonObject>());
     _httpServer.send(200, "text/plain", jsonEncode(body));
 }
 
@@ -48,16 +41,17 @@ void AppServer::_onHistory() {
     auto history = _meter->getHistory();
     DynamicJsonDocument body(10240);
     for (const auto &v: history) {
-        auto entry = body.createNestedObject();
-        entry["timestamp"] = v.getTimestamp();
-        auto cumulative = v.getCumulative();
-        if (cumulative != nullptr) {
-            entry["cumulative"] = *cumulative;
-        }
+        v.toJson(body.createNestedObject());
     }
     _httpServer.send(200, "text/plain", jsonEncode(body));
 }
 
+void AppServer::_onLink() {
+    DynamicJsonDocument body(512);
+    _meter->getLinkStats().toJson(body.to<JsonObject>());
+    _httpServer.send(200, "text/plain", jsonEncode(body));
+}
+
 void AppServer::_onNotFound() {
     _httpServer.send(404);
 }
@@ -27,6 +27,8 @@ private:
 
     void _onHistory();
 
+    void _onLink();
+
     void _onNotFound();
 };
 
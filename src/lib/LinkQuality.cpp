@@ -0,0 +1,189 @@
+#include <Arduino.h>
+
+#include "lib/LinkQuality.h"
+
+/**
+ * Record a frame received without RSSI
+ */
+void LinkQuality::onFrame() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.frames++;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a frame received with RSSI
+ *
+ * @param rssi RSSI (dBm)
+ */
+void LinkQuality::onFrame(int rssi) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.frames++;
+    _window[_stats.samples % WINDOW] = (int8_t) rssi;
+    _stats.samples++;
+    _stats.lastRssi = rssi;
+    _hasRssi = true;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record RSSI of the meter found by scan
+ *
+ * @param rssi RSSI (dBm)
+ */
+void LinkQuality::onScan(int rssi) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.scanRssi = rssi;
+    _stats.hasScanRssi = true;
+    if (_stats.samples == 0) {
+        _stats.lastRssi = rssi;
+        _hasRssi = true;
+    }
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a request timed out
+ */
+void LinkQuality::onTimeout() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.timeouts++;
+    if (_hasRssi) {
+        _timeoutSum += _stats.lastRssi;
+        _stats.timeoutSamples++;
+    }
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a request retransmitted
+ */
+void LinkQuality::onRetransmit() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.retransmits++;
+    if (_hasRssi) {
+        _retransmitSum += _stats.lastRssi;
+        _stats.retransmitSamples++;
+    }
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a request answered after retransmission
+ */
+void LinkQuality::onRecovered() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.recovered++;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Set baud rate of the UART to the Wi-SUN module
+ *
+ * @param baudRate baud rate
+ */
+void LinkQuality::setBaudRate(uint32_t baudRate) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.baudRate = baudRate;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a frame (command or line) sent or received on the UART
+ *
+ * @param bytes frame length
+ */
+void LinkQuality::onUart(size_t bytes) {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.uartFrames++;
+    _stats.uartBytes += bytes;
+    if (_stats.baudRate > 0) {
+        // at the baud rate in effect, 10 bits per byte (start + 8 data + stop)
+        _uartMicros += (uint64_t) bytes * 10 * 1000000 / _stats.baudRate;
+    }
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record received bytes discarded to find the next frame
+ */
+void LinkQuality::onResync() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.resyncs++;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Record a received frame with checksum mismatch
+ */
+void LinkQuality::onChecksumError() {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    _stats.checksumErrors++;
+    xSemaphoreGive(_lock);
+}
+
+/**
+ * Get statistics
+ *
+ * @return snapshot of statistics
+ */
+LinkQuality::Stats LinkQuality::getStats() const {
+    xSemaphoreTake(_lock, portMAX_DELAY);
+    auto stats = _stats;
+    int count = (int) min(_stats.samples, (uint32_t) WINDOW);
+    if (count > 0) {
+        int sum = 0;
+        stats.minRssi = _window[0];
+        stats.maxRssi = _window[0];
+        for (int i = 0; i < count; i++) {
+            sum += _window[i];
+            stats.minRssi = min(stats.minRssi, (int) _window[i]);
+            stats.maxRssi = max(stats.maxRssi, (int) _window[i]);
+        }
+        stats.meanRssi = (float) sum / (float) count;
+    }
+    if (_stats.uartFrames > 0) {
+        stats.uartMicrosPerFrame = (uint32_t) (_uartMicros / _stats.uartFrames);
+    }
+    if (_stats.timeoutSamples > 0) {
+        stats.timeoutRssi = (float) _timeoutSum / (float) _stats.timeoutSamples;
+    }
+    if (_stats.retransmitSamples > 0) {
+        stats.retransmitRssi = (float) _retransmitSum / (float) _stats.retransmitSamples;
+    }
+    xSemaphoreGive(_lock);
+    return stats;
+}
+
+void LinkQuality::Stats::toJson(JsonObject obj) const {
+    obj["frames"] = frames;
+    if (samples > 0) {
+        auto rssi = obj.createNestedObject("rssi");
+        rssi["last"] = lastRssi;
+        rssi["min"] = minRssi;
+        rssi["max"] = maxRssi;
+        rssi["mean"] = meanRssi;
+    }
+    if (hasScanRssi) {
+        obj["scanRssi"] = scanRssi;
+    }
+    obj["timeouts"] = timeouts;
+    if (timeoutSamples > 0) {
+        obj["timeoutRssi"] = timeoutRssi;
+    }
+    obj["retransmits"] = retransmits;
+    if (retransmitSamples > 0) {
+        obj["retransmitRssi"] = retransmitRssi;
+    }
+    obj["recovered"] = recovered;
+    auto uart = obj.createNestedObject("uart");
+    uart["baudRate"] = baudRate;
+    uart["frames"] = uartFrames;
+    uart["bytes"] = uartBytes;
+    uart["microsPerFrame"] = uartMicrosPerFrame;
+    uart["resyncs"] = resyncs;
+    uart["checksumErrors"] = checksumErrors;
+    auto srtt = obj.createNestedObject("srtt");
+    srtt["small"] = srttSmall;
+    srtt["large"] = srttLarge;
+}
@@ -0,0 +1,123 @@
+#if !defined(LIB_LINK_QUALITY_H)
+#define LIB_LINK_QUALITY_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+/**
+ * Link quality of the radio to the smart meter
+ *
+ * RSSI of received frames is kept in a rolling window. Timeouts and retransmissions are recorded with the RSSI
+ * seen just before them, so that radio-range problems (low RSSI at timeouts) can be told from meter-side slowness
+ * (timeouts or long RTT with good RSSI).
+ *
+ * Samples are added by the I/O task and statistics are read from other tasks.
+ */
+class LinkQuality {
+public:
+    /**
+     * Statistics of link quality
+     */
+    struct Stats {
+        /// Frames received
+        uint32_t frames = 0;
+        /// Frames received with RSSI
+        uint32_t samples = 0;
+        /// RSSI of the last frame (dBm)
+        int lastRssi = 0;
+        /// Minimum / maximum / mean RSSI in the window (dBm)
+        int minRssi = 0;
+        int maxRssi = 0;
+        float meanRssi = 0;
+        /// RSSI of the meter at scan (dBm)
+        int scanRssi = 0;
+        bool hasScanRssi = false;
+        /// Timeouts
+        uint32_t timeouts = 0;
+        /// Mean RSSI before timeouts (dBm, valid if timeoutSamples > 0)
+        float timeoutRssi = 0;
+        uint32_t timeoutSamples = 0;
+        /// Retransmissions
+        uint32_t retransmits = 0;
+        /// Mean RSSI before retransmissions (dBm, valid if retransmitSamples > 0)
+        float retransmitRssi = 0;
+        uint32_t retransmitSamples = 0;
+        /// Requests answered after retransmission
+        uint32_t recovered = 0;
+        /// Baud rate of the UART to the Wi-SUN module
+        uint32_t baudRate = 0;
+        /// Frames / bytes on the UART (both directions)
+        uint32_t uartFrames = 0;
+        uint32_t uartBytes = 0;
+        /// Mean time on the wire per UART frame (microseconds, 8N1 at the baud rate when each frame was sent or received)
+        uint32_t uartMicrosPerFrame = 0;
+        /// Times received bytes were discarded to find the next frame
+        uint32_t resyncs = 0;
+        /// Received frames with checksum mismatch
+        uint32_t checksumErrors = 0;
+        /// Smoothed response time (small / large requests, milliseconds)
+        int srttSmall = 0;
+        int srttLarge = 0;
+
+        void toJson(JsonObject obj) const;
+    };
+
+    LinkQuality() : _lock(xSemaphoreCreateMutex()) {};
+
+    ~LinkQuality() { vSemaphoreDelete(_lock); }
+
+    LinkQuality(const LinkQuality &) = delete;
+
+    LinkQuality &operator=(const LinkQuality &) = delete;
+
+    void onFrame();
+
+    void onFrame(int rssi);
+
+    void onScan(int rssi);
+
+    void onTimeout();
+
+    void onRetransmit();
+
+    void onRecovered();
+
+    void setBaudRate(uint32_t baudRate);
+
+    void onUart(size_t bytes);
+
+    void onResync();
+
+    void onChecksumError();
+
+    Stats getStats() const;
+
+    /** Convert LQI (0 - 255) of BP35A to RSSI (dBm) */
+    static int lqiToRssi(int lqi) { return (int) (0.275 * lqi - 104.27); }
+
+private:
+    /// Number of RSSI samples in the window
+    static const int WINDOW = 32;
+
+    SemaphoreHandle_t _lock;
+
+    /// RSSI samples (ring buffer)
+    int8_t _window[WINDOW] = {};
+
+    /// Statistics except for the window
+    Stats _stats;
+
+    /// RSSI is known (sampled or scanned)
+    bool _hasRssi = false;
+
+    /// Sum of RSSI at timeouts
+    long _timeoutSum = 0;
+
+    /// Sum of RSSI at retransmissions
+    long _retransmitSum = 0;
+
+    /// Sum of time on the wire of UART frames (microseconds)
+    uint64_t _uartMicros = 0;
+};
+
+#endif // !defined(LIB_LINK_QUALITY_H)
@@ -0,0 +1,85 @@
+#include <Arduino.h>
+
+#include "lib/LinkRecovery.h"
+
+/**
+ * Rung of the ladder
+ */
+static const struct {
+    /// Attempts before escalating to the next rung
+    int attempts;
+    /// Minimum interval between attempts (milliseconds)
+    unsigned long interval;
+} RUNGS[LinkRecovery::ACTION_MAX] = {
+        {0, 0},  // ACTION_NONE
+        {3, 0},  // ACTION_RETRY
+        {1, 0},  // ACTION_REAUTHENTICATE
+        {2, 5000},  // ACTION_REJOIN
+        {2, 30000},  // ACTION_RESCAN
+        {2, 60000},  // ACTION_RESET_MODULE
+        {1, 0},  // ACTION_REBOOT
+};
+
+/**
+ * Request succeeded: back to the bottom of the ladder
+ */
+void LinkRecovery::onSuccess() {
+    if (_rung != ACTION_NONE) {
+        Serial.printf("Link recovered at %s\n", getName(_rung));
+    }
+    _rung = ACTION_NONE;
+    _pending = ACTION_NONE;
+    for (auto &attempts: _attempts) {
+        attempts = 0;
+    }
+}
+
+/**
+ * Request or join failed: climb the ladder
+ *
+ * @param now current time (milliseconds)
+ * @param atLeast lowest rung that can fix the failure (e.g. rejoin for a lost session)
+ */
+void LinkRecovery::onFailure(unsigned long now, Action atLeast) {
+    if (_pending != ACTION_NONE) {
+        return;
+    }
+    auto rung = _rung < atLeast ? atLeast : _rung;
+    while (rung < ACTION_REBOOT && _attempts[rung] >= RUNGS[rung].attempts) {
+        rung = (Action) (rung + 1);
+    }
+    _rung = rung;
+    _attempts[rung]++;
+    _totals[rung]++;
+
+    // keep the interval from the last attempt of the rung
+    _pendingAt = now;
+    if (_lastAttemptAt[rung] != 0 && now - _lastAttemptAt[rung] < RUNGS[rung].interval) {
+        _pendingAt = _lastAttemptAt[rung] + RUNGS[rung].interval;
+    }
+    _pending = rung;
+    Serial.printf("Link recovery: %s (%d/%d)\n", getName(rung), _attempts[rung], RUNGS[rung].attempts);
+}
+
+/**
+ * Take the action whose time has come
+ *
+ * @param now current time (milliseconds)
+ * @return action to run (ACTION_NONE:nothing)
+ */
+LinkRecovery::Action LinkRecovery::poll(unsigned long now) {
+    if (_pending == ACTION_NONE || (long) (now - _pendingAt) < 0) {
+        return ACTION_NONE;
+    }
+    auto action = _pending;
+    _pending = ACTION_NONE;
+    _lastAttemptAt[action] = now;
+    return action;
+}
+
+const char *LinkRecovery::getName(Action action) {
+    static const char *names[] = {
+            "NONE", "RETRY", "REAUTHENTICATE", "REJOIN", "RESCAN", "RESET_MODULE", "REBOOT",
+    };
+    return names[action];
+}
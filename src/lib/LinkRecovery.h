@@ -0,0 +1,65 @@
+#if !defined(LIB_LINK_RECOVERY_H)
+#define LIB_LINK_RECOVERY_H
+
+/**
+ * Recovery ladder of the link to the smart meter
+ *
+ * Escalates step by step on repeated failures: retry → re-PANA → rejoin with cached session → rescan
+ * → reset module → reboot. Each rung is attempted up to its own count, no sooner than its own interval.
+ * A successful request brings the ladder back to the bottom.
+ */
+class LinkRecovery {
+public:
+    typedef enum {
+        /// Nothing to do
+        ACTION_NONE = 0,
+        /// Let the caller retry the request
+        ACTION_RETRY,
+        /// Re-authenticate PANA session
+        ACTION_REAUTHENTICATE,
+        /// Join again with the cached session
+        ACTION_REJOIN,
+        /// Scan for the meter and join
+        ACTION_RESCAN,
+        /// Reset the Wi-SUN module and join
+        ACTION_RESET_MODULE,
+        /// Reboot
+        ACTION_REBOOT,
+        ACTION_MAX,
+    } Action;
+
+    void onSuccess();
+
+    void onFailure(unsigned long now, Action atLeast = ACTION_RETRY);
+
+    Action poll(unsigned long now);
+
+    /// Rung reached in the current failure episode
+    Action getRung() const { return _rung; }
+
+    /// Number of attempts of the action since boot
+    int getTotal(Action action) const { return _totals[action]; }
+
+    static const char *getName(Action action);
+
+private:
+    /// Current rung
+    Action _rung = ACTION_NONE;
+
+    /// Attempts of each rung in the current failure episode
+    int _attempts[ACTION_MAX] = {};
+
+    /// Attempts of each rung since boot
+    int _totals[ACTION_MAX] = {};
+
+    /// Time of the last attempt of each rung
+    unsigned long _lastAttemptAt[ACTION_MAX] = {};
+
+    /// Action waiting for its interval
+    Action _pending = ACTION_NONE;
+
+    /// Time to run the pending action
+    unsigned long _pendingAt = 0;
+};
+
+#endif // !defined(LIB_LINK_RECOVERY_H)
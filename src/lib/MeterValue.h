@@ -1,31 +1,100 @@
 #if !defined(LIB_METER_VALUE_H)
 #define LIB_METER_VALUE_H
 
-#include <memory>
-#include <utility>
 #include <Arduino.h>
+#include <ArduinoJson.h>
+
+#include "lib/echonet/SmartMeterProperty.h"
 
 /**
  * Smart meter measured value
+ *
+ * Cumulative energy is kept as the raw counter of the meter and converted to kWh only on output.
  */
 class MeterValue {
 public:
-    explicit MeterValue(
-            time_t timestamp,
-            std::shared_ptr<uint32_t> instantaneous,
-            std::shared_ptr<double> cumulative
-    ) : _timestamp(timestamp), _instantaneous(std::move(instantaneous)), _cumulative(std::move(cumulative)) {};
+    explicit MeterValue(time_t timestamp) : _timestamp(timestamp) {};
 
     time_t getTimestamp() const { return _timestamp; }
 
-    std::shared_ptr<uint32_t> getInstantaneous() const { return _instantaneous; }
+    bool hasInstantaneous() const { return _hasInstantaneous; }
+
+    /** 瞬時電力計測値 (W) */
+    int32_t getInstantaneous() const { return _instantaneous; }
+
+    void setInstantaneous(int32_t instantaneous) {
+        _instantaneous = instantaneous;
+        _hasInstantaneous = true;
+    }
+
+    bool hasCumulative() const { return _hasCumulative; }
+
+    /** 積算電力量計測値 (raw counter) */
+    uint32_t getCumulative() const { return _cumulative; }
+
+    const SmartMeterEnergyScale &getScale() const { return _scale; }
+
+    void setCumulative(uint32_t cumulative, const SmartMeterEnergyScale &scale) {
+        _cumulative = cumulative;
+        _scale = scale;
+        _hasCumulative = true;
+    }
+
+    /** 積算電力量計測値 (kWh) */
+    double getCumulativeKwh() const { return _scale.apply<SmartMeterCumulativeForward>(_cumulative); }
+
+    bool hasCumulativeReverse() const { return _hasCumulativeReverse; }
+
+    /** 積算電力量計測値 (逆方向, raw counter) */
+    uint32_t getCumulativeReverse() const { return _cumulativeReverse; }
+
+    void setCumulativeReverse(uint32_t cumulativeReverse, const SmartMeterEnergyScale &scale) {
+        _cumulativeReverse = cumulativeReverse;
+        _scale = scale;
+        _hasCumulativeReverse = true;
+    }
+
+    /** 積算電力量計測値 (逆方向, kWh) */
+    double getCumulativeReverseKwh() const { return _scale.apply<SmartMeterCumulativeReverse>(_cumulativeReverse); }
+
+    /**
+     * Cumulative counts since the base value, taking the counter wrap-around (積算電力量有効桁数) into account
+     *
+     * @param base base value
+     * @return counts
+     */
+    uint32_t getCumulativeDelta(const MeterValue &base) const {
+        const uint32_t modulo = _scale.modulo();
+        return (_cumulative + modulo - base._cumulative) % modulo;
+    }
 
-    std::shared_ptr<double> getCumulative() const { return _cumulative; }
+    /**
+     * Emit JSON fields
+     *
+     * @param obj JSON object
+     */
+    void toJson(JsonObject obj) const {
+        obj["timestamp"] = _timestamp;
+        if (_hasInstantaneous) {
+            smartMeterToJson<SmartMeterInstantaneousPower>(obj, _instantaneous);
+        }
+        if (_hasCumulative) {
+            smartMeterToJson<SmartMeterCumulativeForward>(obj, getCumulativeKwh());
+        }
+        if (_hasCumulativeReverse) {
+            smartMeterToJson<SmartMeterCumulativeReverse>(obj, getCumulativeReverseKwh());
+        }
+    }
 
 private:
     time_t _timestamp;
-    std::shared_ptr<uint32_t> _instantaneous;
-    std::shared_ptr<double> _cumulative;
+    bool _hasInstantaneous = false;
+    bool _hasCumulative = false;
+    bool _hasCumulativeReverse = false;
+    int32_t _instantaneous = 0;
+    uint32_t _cumulative = 0;
+    uint32_t _cumulativeReverse = 0;
+    SmartMeterEnergyScale _scale;
 };
 
 #endif // !defined(LIB_METER_VALUE_H)
@@ -0,0 +1,89 @@
+#if !defined(LIB_RING_BUFFER_H)
+#define LIB_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Lock-free ring buffer of bytes for one producer and one consumer
+ *
+ * The producer only writes _head and the consumer only writes _tail, so no lock is needed between two tasks.
+ *
+ * @tparam SIZE capacity (power of 2)
+ */
+template<size_t SIZE>
+class RingBuffer {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of 2");
+
+public:
+    /** Bytes available to read (consumer) */
+    size_t available() const {
+        return _head.load(std::memory_order_acquire) - _tail.load(std::memory_order_relaxed);
+    }
+
+    /** Free space to write (producer) */
+    size_t space() const {
+        return SIZE - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+    }
+
+    /**
+     * Write bytes (producer)
+     *
+     * @param data data
+     * @param len data length
+     * @return bytes written (less than len if full)
+     */
+    size_t write(const uint8_t *data, size_t len) {
+        auto head = _head.load(std::memory_order_relaxed);
+        auto n = len < space() ? len : space();
+        for (size_t i = 0; i < n; i++) {
+            _buffer[(head + i) & (SIZE - 1)] = data[i];
+        }
+        _head.store(head + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Read bytes (consumer)
+     *
+     * @param data buffer
+     * @param len buffer length
+     * @return bytes read
+     */
+    size_t read(uint8_t *data, size_t len) {
+        auto tail = _tail.load(std::memory_order_relaxed);
+        auto n = len < available() ? len : available();
+        for (size_t i = 0; i < n; i++) {
+            data[i] = _buffer[(tail + i) & (SIZE - 1)];
+        }
+        _tail.store(tail + n, std::memory_order_release);
+        return n;
+    }
+
+    /**
+     * Read a byte (consumer)
+     *
+     * @return byte (-1:empty)
+     */
+    int read() {
+        uint8_t c;
+        return read(&c, 1) == 1 ? c : -1;
+    }
+
+    /** Discard all bytes (consumer) */
+    void clear() {
+        _tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    uint8_t _buffer[SIZE] = {};
+
+    /// Total bytes written
+    std::atomic<size_t> _head{0};
+
+    /// Total bytes read
+    std::atomic<size_t> _tail{0};
+};
+
+#endif // !defined(LIB_RING_BUFFER_H)
@@ -0,0 +1,43 @@
+#include <algorithm>
+#include <cstdlib>
+
+#include "lib/RttEstimator.h"
+
+/**
+ * Get timeout
+ *
+ * @return timeout (milliseconds)
+ */
+int RttEstimator::getTimeout() const {
+    if (!_hasSample) {
+        return _maxTimeout;
+    }
+    int timeout = std::max(_minTimeout, _srtt + 4 * _rttvar);
+    return std::min(_maxTimeout, timeout * _backoff);
+}
+
+/**
+ * Update by measured RTT
+ *
+ * @param rtt round-trip time of a request answered without retransmission (milliseconds)
+ */
+void RttEstimator::update(int rtt) {
+    if (!_hasSample) {
+        _srtt = rtt;
+        _rttvar = rtt / 2;
+        _hasSample = true;
+    } else {
+        _rttvar = (3 * _rttvar + std::abs(_srtt - rtt)) / 4;
+        _srtt = (7 * _srtt + rtt) / 8;
+    }
+    _backoff = 1;
+}
+
+/**
+ * Back off after timeout
+ */
+void RttEstimator::backoff() {
+    if (_hasSample && getTimeout() < _maxTimeout) {
+        _backoff *= 2;
+    }
+}
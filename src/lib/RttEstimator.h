@@ -0,0 +1,43 @@
+#if !defined(LIB_RTT_ESTIMATOR_H)
+#define LIB_RTT_ESTIMATOR_H
+
+/**
+ * Round-trip time estimator
+ *
+ * Derives the response timeout from smoothed RTT and its variance in the same way as TCP's RTO (RFC 6298).
+ */
+class RttEstimator {
+public:
+    explicit RttEstimator(int minTimeout, int maxTimeout) : _minTimeout(minTimeout), _maxTimeout(maxTimeout) {};
+
+    int getTimeout() const;
+
+    void update(int rtt);
+
+    void backoff();
+
+    int getSmoothedRtt() const { return _srtt; }
+
+    int getRttVariance() const { return _rttvar; }
+
+private:
+    /// Lower bound of timeout (milliseconds)
+    int _minTimeout;
+
+    /// Upper bound of timeout (milliseconds)
+    int _maxTimeout;
+
+    /// Smoothed RTT (milliseconds)
+    int _srtt = 0;
+
+    /// RTT variance (milliseconds)
+    int _rttvar = 0;
+
+    /// Backoff multiplier since the last sample
+    int _backoff = 1;
+
+    /// Sampled at least once
+    bool _hasSample = false;
+};
+
+#endif // !defined(LIB_RTT_ESTIMATOR_H)
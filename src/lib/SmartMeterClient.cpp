@@ -1,8 +1,22 @@
 #include <iomanip>
-#include <map>
 #include <M5Unified.h>
 
 #include "lib/SmartMeterClient.h"
+#include "lib/nvs.h"
+#include "lib/utils.h"
+
+/// NVS key of cached property maps
+static const char *PROPERTY_MAPS_KEY = "propmaps";
+
+/**
+ * Property maps cached in NVS
+ */
+typedef struct {
+    char meterAddress[17];
+    uint8_t infMap[EchonetLitePropertyMap::SIZE];
+    uint8_t setMap[EchonetLitePropertyMap::SIZE];
+    uint8_t getMap[EchonetLitePropertyMap::SIZE];
+} __attribute__((packed)) smart_meter_property_maps_t;
 
 /**
  * Connect to smart meter
@@ -13,16 +27,120 @@ bool SmartMeterClient::connect() {
     if (!_wisun->connect(_brouteId, _broutePassword)) {
         return false;
     }
+    return _onConnected();
+}
+
+/**
+ * Prepare requests after joined to the meter
+ *
+ * @return true:success, false:failure
+ */
+bool SmartMeterClient::_onConnected() {
+    // Refusals may have been caused by the previous session
+    _unsupported.reset();
+    memset(_refusals, 0, sizeof(_refusals));
+
+    // Resolve supported properties (once per meter)
+    _getPropertyMaps();
 
-    // Get Cumulative unit
-    _cumulativePow = _getMeterCumulativePow();
-    if (_cumulativePow == nullptr) {
+    // Get scale of cumulative energy
+    if (!_getEnergyScale()) {
         return false;
     }
 
     return true;
 }
 
+/**
+ * Start the I/O task
+ *
+ * The I/O task advances the join sequence without blocking, then runs queued commands and dispatches notifications.
+ * Commands queued while connecting are run after connected.
+ * Failures of requests and joins climb the recovery ladder (see LinkRecovery), which is run by the I/O task.
+ */
+void SmartMeterClient::begin() {
+    if (_state != STATE_IDLE) {
+        return;
+    }
+    _commands = xQueueCreate(MAX_COMMANDS, sizeof(Command *));
+    _state = STATE_CONNECTING;
+    xTaskCreatePinnedToCore(
+            [](void *arg) {
+                auto *self = (SmartMeterClient *) arg;
+                self->_run();
+            },
+            "SmartMeter",
+            8192,
+            this,
+            1,
+            &_taskHandle,
+            APP_CPU_NUM
+    );
+}
+
+/**
+ * 現在の計測値を非同期に取得
+ *
+ * @param callback completion callback (called on the I/O task)
+ * @return future
+ */
+SmartMeterFuture<MeterValue> SmartMeterClient::getMeterValueAsync(SmartMeterFuture<MeterValue>::Callback callback) {
+    SmartMeterFuture<MeterValue> future(std::move(callback));
+    if (!_post(new Command{
+            [this] { return requestMeterValue(); },
+            [this, future](int ticket) { future.resolve(receiveMeterValue(ticket), _lastError); },
+            -1,
+    })) {
+        future.resolve(nullptr, SmartMeterError(SmartMeterError::BUSY));
+    }
+    return future;
+}
+
+/**
+ * 積算電力量計測値履歴を非同期に取得
+ *
+ * @param day 履歴日 (0:当日 / n:n日前)
+ * @param callback completion callback (called on the I/O task)
+ * @return future
+ */
+SmartMeterFuture<std::vector<MeterValue>> SmartMeterClient::getMeterHistoryAsync(
+        int day, SmartMeterFuture<std::vector<MeterValue>>::Callback callback) {
+    SmartMeterFuture<std::vector<MeterValue>> future(std::move(callback));
+    if (!_post(new Command{
+            [this, day] { return _submitHistoryDay(day); },
+            [this, future](int ticket) { future.resolve(receiveMeterHistory(ticket), _lastError); },
+            -1,
+            SmartMeterError(),
+            [this](int ticket) { return _submitHistory(ticket); },
+    })) {
+        future.resolve(nullptr, SmartMeterError(SmartMeterError::BUSY));
+    }
+    return future;
+}
+
+/**
+ * 積算電力量計測値履歴２を非同期に取得
+ *
+ * @param latest 最新コマの日時
+ * @param count コマ数 (1 - 12)
+ * @param callback completion callback (called on the I/O task)
+ * @return future
+ */
+SmartMeterFuture<std::vector<MeterValue>> SmartMeterClient::getMeterHistory2Async(
+        time_t latest, int count, SmartMeterFuture<std::vector<MeterValue>>::Callback callback) {
+    SmartMeterFuture<std::vector<MeterValue>> future(std::move(callback));
+    if (!_post(new Command{
+            [this, latest, count] { return _submitHistory2DateTime(latest, count); },
+            [this, future](int ticket) { future.resolve(receiveMeterHistory2(ticket), _lastError); },
+            -1,
+            SmartMeterError(),
+            [this](int ticket) { return _submitHistory2(ticket); },
+    })) {
+        future.resolve(nullptr, SmartMeterError(SmartMeterError::BUSY));
+    }
+    return future;
+}
+
 /**
  * 積算電力量計測値履歴
  *
@@ -30,251 +148,1060 @@ bool SmartMeterClient::connect() {
  * @return 積算電力量計測値履歴
  */
 std::unique_ptr<std::vector<MeterValue>> SmartMeterClient::getMeterHistory(int day) {
+    return receiveMeterHistory(requestMeterHistory(day));
+}
+
+/**
+ * 積算電力量計測値履歴を要求
+ *
+ * Sets the collection day and leaves the history read outstanding so that other requests can overlap it.
+ *
+ * @param day 履歴日 (0:当日 / n:n日前)
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::requestMeterHistory(int day) {
+    return _submitHistory(_submitHistoryDay(day));
+}
+
+/**
+ * 積算履歴収集日 (0xE5) 設定を送信
+ *
+ * @param day 履歴日 (0:当日 / n:n日前)
+ * @return ticket (-1:failure, the date of the day is kept as its timestamp)
+ */
+int SmartMeterClient::_submitHistoryDay(int day) {
     struct tm tm{};
     if (!getLocalTime(&tm)) {
-        return nullptr;
+        return -1;
     }
     tm.tm_hour = tm.tm_min = tm.tm_sec = 0;
     tm.tm_mday -= day;
     time_t timestamp = mktime(&tm);
 
-    // 積算電力量計測値履歴(1 日単位)取得
-    std::vector<uint8_t> v = {(uint8_t) day};
-    std::map<uint8_t, std::vector<uint8_t>> setProps = {
-            {0xe5, v},  // 積算履歴収集日1
-    };
-    _setProperty(setProps);
-    std::vector<uint8_t> getProps = {
-            0xe2,  // 積算電力量計測値履歴1(正方向計測値)
-    };
-    auto getRes = _getProperty(getProps);
+    static constexpr EchonetLiteSetCRequest<
+            EchonetLiteRequestProperty<SmartMeterHistoryCollectionDay::epc, SmartMeterHistoryCollectionDay::size>
+    > SET_REQUEST{};
+    auto setRequest = SET_REQUEST;
+    *setRequest.getEdt<0>() = (uint8_t) day;
+    // 0x71: Set_Res
+    return _submit(setRequest.getData(), setRequest.getSize(), 0x71, timestamp);
+}
+
+/**
+ * 積算電力量計測値履歴 (0xE2, 0xE4) 取得を送信
+ *
+ * 正方向と逆方向を同じフレームで取得する。
+ *
+ * @param setTicket ticket of the collection day setting (otherwise the day set before would be read as the day)
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::_submitHistory(int setTicket) {
+    if (setTicket < 0) {
+        return -1;
+    }
+    time_t timestamp = _pending[setTicket].timestamp;
+    if (_await(setTicket) == nullptr) {
+        return -1;
+    }
+    static constexpr EchonetLiteGetRequest<
+            SmartMeterCumulativeHistoryForward::epc,
+            SmartMeterCumulativeHistoryReverse::epc
+    > GET_REQUEST{};
+    auto getRequest = GET_REQUEST;
+    // 0x72: Get_Res
+    return _submit(getRequest.getData(), getRequest.getSize(), 0x72, timestamp);
+}
+
+/**
+ * 積算電力量計測値履歴を受信
+ *
+ * @param ticket ticket returned by requestMeterHistory()
+ * @return 積算電力量計測値履歴
+ */
+std::unique_ptr<std::vector<MeterValue>> SmartMeterClient::receiveMeterHistory(int ticket) {
+    if (ticket < 0) {
+        return nullptr;
+    }
+    time_t timestamp = _pending[ticket].timestamp;
+    auto getRes = _await(ticket);
     if (getRes == nullptr) {
         return nullptr;
     }
-    if (!(getRes->count(0xe2) > 0 && getRes->at(0xe2).size() == 194)) {
+    EchonetLiteFrame frame(getRes->data(), getRes->size());
+    EchonetLiteProperty history{};
+    if (!SmartMeterCumulativeHistoryForward::find(frame, history)) {
+        _lastError = SmartMeterError(SmartMeterError::INVALID_RESPONSE);
         return nullptr;
     }
+    // 逆方向 is optional (not supported or refused)
+    EchonetLiteProperty historyReverse{};
+    bool hasReverse = SmartMeterCumulativeHistoryReverse::find(frame, historyReverse);
 
     auto result = std::make_unique<std::vector<MeterValue>>();
-    auto e2 = getRes->at(0xe2);
-    int idx = 2;
-    for (int i = 0; i < 48; i++) {
-        uint32_t cumulative = e2[idx] << 24 | e2[idx + 1] << 16 | e2[idx + 2] << 8 | e2[idx + 3];
-        if (cumulative == 0xfffffffe) {
+    for (size_t i = 0; i < SmartMeterCumulativeHistoryForward::count; i++, timestamp += 1800) {
+        SmartMeterCumulativeForward::type cumulative;
+        if (!SmartMeterCumulativeHistoryForward::decode(history, i, cumulative)) {
             continue;
         }
-        result->push_back(MeterValue(
-                timestamp, nullptr,
-                std::make_unique<double>(cumulative * pow(10, *_cumulativePow))));
-        timestamp += 1800;
-        idx += 4;
+        MeterValue value(timestamp);
+        value.setCumulative(cumulative, _scale);
+        SmartMeterCumulativeReverse::type cumulativeReverse;
+        if (hasReverse && SmartMeterCumulativeHistoryReverse::decode(historyReverse, i, cumulativeReverse)) {
+            value.setCumulativeReverse(cumulativeReverse, _scale);
+        }
+        result->push_back(value);
     }
     return result;
 }
 
 /**
- * 現在の計測値を取得
+ * 積算電力量計測値履歴２
  *
- * @return 現在の計測値
+ * @param latest 最新コマの日時
+ * @param count コマ数 (1 - 12)
+ * @return 積算電力量計測値履歴 (古い順)
  */
-std::unique_ptr<MeterValue> SmartMeterClient::getMeterValue() {
-    time_t timestamp;
-    time(&timestamp);
-    std::vector<uint8_t> props = {
-            0xe7,  // 瞬時電力計測値 (W)
-            0xe0,  // 積算電力量計測値(正方向計測値)
-    };
-    auto getRes = _getProperty(props);
+std::unique_ptr<std::vector<MeterValue>> SmartMeterClient::getMeterHistory2(time_t latest, int count) {
+    return receiveMeterHistory2(requestMeterHistory2(latest, count));
+}
+
+/**
+ * 積算電力量計測値履歴２を要求
+ *
+ * Only the requested slots are transferred, instead of a whole day of 0xE2.
+ *
+ * @param latest 最新コマの日時
+ * @param count コマ数 (1 - 12)
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::requestMeterHistory2(time_t latest, int count) {
+    return _submitHistory2(_submitHistory2DateTime(latest, count));
+}
+
+/**
+ * 積算履歴収集日２ (日時, コマ数) 設定を送信
+ *
+ * @param latest 最新コマの日時
+ * @param count コマ数 (1 - 12)
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::_submitHistory2DateTime(time_t latest, int count) {
+    if (count < 1 || count > SmartMeterHistoryCollectionDateTime2::maxCount) {
+        return -1;
+    }
+    static constexpr EchonetLiteSetCRequest<
+            EchonetLiteRequestProperty<
+                    SmartMeterHistoryCollectionDateTime2::epc, SmartMeterHistoryCollectionDateTime2::size>
+    > SET_REQUEST{};
+    auto setRequest = SET_REQUEST;
+    SmartMeterHistoryCollectionDateTime2::encode(setRequest.getEdt<0>(), latest, count);
+    // 0x71: Set_Res
+    return _submit(setRequest.getData(), setRequest.getSize(), 0x71, latest);
+}
+
+/**
+ * 積算電力量計測値履歴２ (0xEC) 取得を送信
+ *
+ * @param setTicket ticket of the collection date and time setting
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::_submitHistory2(int setTicket) {
+    if (setTicket < 0) {
+        return -1;
+    }
+    time_t latest = _pending[setTicket].timestamp;
+    if (_await(setTicket) == nullptr) {
+        return -1;
+    }
+    static constexpr EchonetLiteGetRequest<SmartMeterCumulativeHistory2::epc> GET_REQUEST{};
+    auto getRequest = GET_REQUEST;
+    // 0x72: Get_Res
+    return _submit(getRequest.getData(), getRequest.getSize(), 0x72, latest);
+}
+
+/**
+ * 積算電力量計測値履歴２を受信
+ *
+ * @param ticket ticket returned by requestMeterHistory2()
+ * @return 積算電力量計測値履歴 (古い順)
+ */
+std::unique_ptr<std::vector<MeterValue>> SmartMeterClient::receiveMeterHistory2(int ticket) {
+    if (ticket < 0) {
+        return nullptr;
+    }
+    auto getRes = _await(ticket);
     if (getRes == nullptr) {
         return nullptr;
     }
-    if (!(getRes->count(0xe7) > 0 && getRes->at(0xe7).size() == 4)
-        || !(getRes->count(0xe0) > 0 && getRes->at(0xe0).size() == 4)) {
+    EchonetLiteFrame frame(getRes->data(), getRes->size());
+    EchonetLiteProperty history{};
+    time_t latest;
+    size_t count;
+    if (!SmartMeterCumulativeHistory2::find(frame, history, latest, count)) {
+        _lastError = SmartMeterError(SmartMeterError::INVALID_RESPONSE);
         return nullptr;
     }
 
-    auto e7 = getRes->at(0xe7);
-    auto instantaneous = e7[0] << 24 | e7[1] << 16 | e7[2] << 8 | e7[3];
-    auto e0 = getRes->at(0xe0);
-    auto cumulative = e0[0] << 24 | e0[1] << 16 | e0[2] << 8 | e0[3];
-    return std::make_unique<MeterValue>(
-            timestamp, std::make_unique<uint32_t>(instantaneous),
-            std::make_unique<double>(cumulative * pow(10, *_cumulativePow)));
+    auto result = std::make_unique<std::vector<MeterValue>>();
+    for (size_t i = count; i-- > 0;) {
+        SmartMeterCumulativeForward::type cumulative;
+        if (!SmartMeterCumulativeHistory2::decodeForward(history, i, cumulative)) {
+            continue;
+        }
+        MeterValue value(latest - 1800 * (time_t) i);
+        value.setCumulative(cumulative, _scale);
+        SmartMeterCumulativeReverse::type cumulativeReverse;
+        if (SmartMeterCumulativeHistory2::decodeReverse(history, i, cumulativeReverse)) {
+            value.setCumulativeReverse(cumulativeReverse, _scale);
+        }
+        result->push_back(value);
+    }
+    return result;
+}
+
+/**
+ * 現在の計測値を取得
+ *
+ * @return 現在の計測値
+ */
+std::unique_ptr<MeterValue> SmartMeterClient::getMeterValue() {
+    return receiveMeterValue(requestMeterValue());
 }
 
 /**
- * 積算電力量単位を取得
+ * 現在の計測値を要求
  *
- * @return 積算電力量単位
+ * @return ticket (-1:failure)
  */
-std::unique_ptr<int> SmartMeterClient::_getMeterCumulativePow() {
+int SmartMeterClient::requestMeterValue() {
     time_t timestamp;
     time(&timestamp);
-    std::vector<uint8_t> props = {
-            0xe1,  // 積算電力量単位(正方向、逆方向計測値)
-    };
-    auto getRes = _getProperty(props);
+    static constexpr EchonetLiteGetRequest<
+            SmartMeterInstantaneousPower::epc,
+            SmartMeterCumulativeForward::epc,
+            SmartMeterCumulativeReverse::epc
+    > REQUEST{};
+    auto request = REQUEST;
+    return _submit(request.getData(), request.getSize(), 0x72, timestamp);
+}
+
+/**
+ * 現在の計測値を受信
+ *
+ * @param ticket ticket returned by requestMeterValue()
+ * @return 現在の計測値
+ */
+std::unique_ptr<MeterValue> SmartMeterClient::receiveMeterValue(int ticket) {
+    if (ticket < 0) {
+        return nullptr;
+    }
+    time_t timestamp = _pending[ticket].timestamp;
+    auto getRes = _await(ticket);
     if (getRes == nullptr) {
         return nullptr;
     }
-    if (!(getRes->count(0xe1) > 0 && getRes->at(0xe1).size() == 1)) {
+    EchonetLiteFrame frame(getRes->data(), getRes->size());
+    SmartMeterInstantaneousPower::type instantaneous;
+    SmartMeterCumulativeForward::type cumulative;
+    if (!SmartMeterInstantaneousPower::decode(frame, instantaneous)
+        || !SmartMeterCumulativeForward::decode(frame, cumulative)) {
+        _lastError = SmartMeterError(SmartMeterError::INVALID_RESPONSE);
         return nullptr;
     }
 
-    auto e1 = getRes->at(0xe1);
-    auto cumulativeUnit = e1[0];
-    int cumulativePow = 0;
-    if (cumulativeUnit > 0 && cumulativeUnit <= 4) {
-        cumulativePow = -cumulativeUnit;
-    } else if (cumulativeUnit >= 10 && cumulativeUnit <= 13) {
-        cumulativePow = cumulativeUnit - 9;
+    auto result = std::make_unique<MeterValue>(timestamp);
+    result->setInstantaneous(instantaneous);
+    result->setCumulative(cumulative, _scale);
+    // 逆方向 is optional (not supported or refused)
+    SmartMeterCumulativeReverse::type cumulativeReverse;
+    if (SmartMeterCumulativeReverse::decode(frame, cumulativeReverse)) {
+        result->setCumulativeReverse(cumulativeReverse, _scale);
+    }
+    return result;
+}
+
+/**
+ * Configure per-frame retransmission
+ *
+ * A request without response is retransmitted with the same TID, so that a late response to an earlier
+ * transmission still completes it. The interval starts at the response timeout and doubles with ±25% jitter.
+ *
+ * @param maxAttempts attempts including the first transmission (1:no retransmission)
+ * @param maxInterval upper bound of the retransmission interval (milliseconds)
+ */
+void SmartMeterClient::setRetransmission(int maxAttempts, int maxInterval) {
+    _maxAttempts = max(maxAttempts, 1);
+    _maxRetransmitInterval = maxInterval;
+}
+
+/**
+ * Get link quality statistics
+ *
+ * @return RSSI of received frames, timeouts and response times
+ */
+LinkQuality::Stats SmartMeterClient::getLinkStats() const {
+    auto stats = _wisun->getLinkQuality().getStats();
+    stats.srttSmall = _rtt[REQUEST_CLASS_SMALL].getSmoothedRtt();
+    stats.srttLarge = _rtt[REQUEST_CLASS_LARGE].getSmoothedRtt();
+    return stats;
+}
+
+/**
+ * Wait for notifications from the meter
+ *
+ * Responses of outstanding requests received meanwhile are kept for them.
+ *
+ * @param timeout timeout (milliseconds)
+ */
+void SmartMeterClient::poll(int timeout) {
+    _dispatch(timeout);
+}
+
+/**
+ * I/O task
+ *
+ * Commands are submitted as long as a request slot is free, so that they overlap on the radio.
+ * One slot is kept for the Set request issued inside requestMeterHistory().
+ */
+void SmartMeterClient::_run() {
+    _wisun->startConnect(_brouteId, _broutePassword, WiSUN::CONNECT_MODE_BOOT);
+
+#pragma clang diagnostic push
+#pragma ide diagnostic ignored "EndlessLoop"
+    while (true) {
+        _recover(_recovery.poll(millis()));
+
+        if (_state != STATE_CONNECTED && _state != STATE_REAUTHENTICATING) {
+            if (_state == STATE_CONNECTING) {
+                switch (_wisun->pollConnect()) {
+                    case WiSUN::CONNECT_SUCCEEDED:
+                        if (_onConnected()) {
+                            _state = STATE_CONNECTED;
+                        } else {
+                            _state = STATE_DISCONNECTED;
+                            _onLinkFailure(LinkRecovery::ACTION_REJOIN);
+                        }
+                        break;
+                    case WiSUN::CONNECT_FAILED:
+                        _state = STATE_DISCONNECTED;
+                        _onLinkFailure(LinkRecovery::ACTION_REJOIN);
+                        break;
+                    default:
+                        break;
+                }
+            }
+            delay(10);
+            continue;
+        }
+
+        // follow PANA session (commands are held while re-authenticating)
+        _wisun->maintainSession();
+        _updateSessionState();
+
+        Command *command;
+        while (_state == STATE_CONNECTED && _inFlight.size() < MAX_PENDING - 1
+               && xQueueReceive(_commands, &command, 0) == pdTRUE) {
+            command->ticket = command->submit();
+            if (command->ticket < 0) {
+                // _lastError is overwritten by other commands until this one is completed
+                command->error = _lastError;
+            }
+            _inFlight.push_back(command);
+        }
+
+        // wait for responses and notifications
+        _dispatch(_inFlight.empty() ? 100 : 20);
+        _retransmitDue();
+
+        for (auto it = _inFlight.begin(); it != _inFlight.end();) {
+            command = *it;
+            if (command->ticket >= 0 && !_isDone(command->ticket)) {
+                ++it;
+                continue;
+            }
+            if (command->ticket >= 0 && command->then) {
+                // submit the next request from the response (never blocks: the response is already here)
+                auto then = std::move(command->then);
+                command->then = nullptr;
+                command->ticket = then(command->ticket);
+                if (command->ticket < 0) {
+                    command->error = _lastError;
+                }
+                ++it;
+                continue;
+            }
+            it = _inFlight.erase(it);
+            _complete(command);
+        }
+    }
+#pragma clang diagnostic pop
+}
+
+/**
+ * Reflect PANA session state of the Wi-SUN module to the connection state
+ */
+void SmartMeterClient::_updateSessionState() {
+    switch (_wisun->getSessionState()) {
+        case WiSUN::SESSION_ESTABLISHED:
+            _state = STATE_CONNECTED;
+            break;
+        case WiSUN::SESSION_REAUTHENTICATING:
+            _state = STATE_REAUTHENTICATING;
+            break;
+        default:
+            Serial.println("ERROR: PANA session lost");
+            _state = STATE_DISCONNECTED;
+            _abortInFlight();
+            _onLinkFailure(LinkRecovery::ACTION_REJOIN);
+            break;
+    }
+}
+
+/**
+ * Run the action of the recovery ladder
+ *
+ * @param action action returned by LinkRecovery::poll()
+ */
+void SmartMeterClient::_recover(LinkRecovery::Action action) {
+    switch (action) {
+        case LinkRecovery::ACTION_REAUTHENTICATE:
+            if (_state == STATE_CONNECTED) {
+                _wisun->reauthenticate();
+            }
+            break;
+        case LinkRecovery::ACTION_REJOIN:
+            _reconnect(WiSUN::CONNECT_MODE_REJOIN);
+            break;
+        case LinkRecovery::ACTION_RESCAN:
+            _reconnect(WiSUN::CONNECT_MODE_RESCAN);
+            break;
+        case LinkRecovery::ACTION_RESET_MODULE:
+            _reconnect(WiSUN::CONNECT_MODE_BOOT);
+            break;
+        case LinkRecovery::ACTION_REBOOT:
+            _abortInFlight();
+            _state = STATE_FAILED;
+            break;
+        default:
+            // ACTION_RETRY: the caller retries on its next request
+            break;
+    }
+}
+
+/**
+ * Join to the meter again
+ *
+ * @param mode join mode
+ */
+void SmartMeterClient::_reconnect(WiSUN::ConnectMode mode) {
+    _abortInFlight();
+    _state = STATE_CONNECTING;
+    _wisun->startConnect(_brouteId, _broutePassword, mode);
+}
+
+/**
+ * Complete in-flight commands with DISCONNECTED
+ */
+void SmartMeterClient::_abortInFlight() {
+    for (auto &pending: _pending) {
+        pending.active = false;
+        pending.response = nullptr;
+    }
+    while (!_inFlight.empty()) {
+        auto *command = _inFlight.front();
+        _inFlight.pop_front();
+        command->ticket = -1;
+        command->error = SmartMeterError(SmartMeterError::DISCONNECTED);
+        _complete(command);
+    }
+}
+
+/**
+ * Complete the command and resolve its future
+ *
+ * The future is resolved with _lastError: set by receiving the response, or restored from the command if it failed
+ * without a response.
+ *
+ * @param command command (deleted)
+ */
+void SmartMeterClient::_complete(Command *command) {
+    if (command->ticket < 0) {
+        _lastError = command->error;
+    }
+    command->complete(command->ticket);
+    delete command;
+}
+
+/**
+ * Report a failure of the link to the recovery ladder
+ *
+ * @param atLeast lowest rung that can fix the failure
+ */
+void SmartMeterClient::_onLinkFailure(LinkRecovery::Action atLeast) {
+    _recovery.onFailure(millis(), atLeast);
+}
+
+/**
+ * Queue a command to the I/O task
+ *
+ * @param command command (owned by the I/O task if queued)
+ * @return true:queued, false:queue is full
+ */
+bool SmartMeterClient::_post(Command *command) {
+    if (_commands == nullptr || xQueueSend(_commands, &command, 0) != pdTRUE) {
+        Serial.println("ERROR: Too many queued commands");
+        delete command;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Check if the request has been answered or timed out
+ *
+ * @param ticket ticket returned by _submit()
+ * @return true:receive*() returns without waiting
+ */
+bool SmartMeterClient::_isDone(int ticket) const {
+    const auto &pending = _pending[ticket];
+    return pending.response != nullptr
+           || (pending.attempts >= _maxAttempts && (int) (millis() - pending.sentAt) >= pending.timeout);
+}
+
+/**
+ * Retransmit the request with the same TID
+ *
+ * @param pending outstanding request whose response timed out
+ */
+void SmartMeterClient::_retransmit(PendingRequest &pending) {
+    pending.attempts++;
+    // exponential backoff with jitter (±25%), never shorter than the previous timeout
+    // (the cap may be below the adaptive timeout of large requests)
+    int previous = pending.timeout;
+    int interval = max(previous, min(previous * 2, _maxRetransmitInterval));
+    pending.timeout = max(previous, interval + (int) random(-interval / 4, interval / 4 + 1));
+    pending.sentAt = millis();
+    Serial.printf("Retransmit: TID=%04x (%d/%d, next %d ms)\n",
+                  pending.tid, pending.attempts, _maxAttempts, pending.timeout);
+    _wisun->getLinkQuality().onRetransmit();
+    if (!_wisun->sendData(pending.frame.data(), pending.frame.size(), 5000)) {
+        // lost as well as the previous transmission
+        Serial.printf("ERROR: Failed to retransmit: TID=%04x\n", pending.tid);
+    }
+}
+
+/**
+ * Retransmit requests whose response timed out
+ *
+ * Held while re-authenticating: the requests are retransmitted after the session is back, or aborted if it is lost.
+ */
+void SmartMeterClient::_retransmitDue() {
+    if (_state == STATE_REAUTHENTICATING) {
+        return;
+    }
+    for (auto &pending: _pending) {
+        if (pending.active && pending.response == nullptr && pending.attempts < _maxAttempts
+            && (int) (millis() - pending.sentAt) >= pending.timeout) {
+            _retransmit(pending);
+        }
     }
-    return std::make_unique<int>(cumulativePow);
 }
 
 /**
- * プロパティ値受信
+ * 積算電力量の単位と係数を取得
  *
+ * @return true:success, false:failure
+ */
+bool SmartMeterClient::_getEnergyScale() {
+    static constexpr EchonetLiteGetRequest<SmartMeterCumulativeUnit::epc> UNIT_REQUEST{};
+    auto unitRequest = UNIT_REQUEST;
+    auto unitRes = _request(unitRequest.getData(), unitRequest.getSize(), 0x72);
+    if (unitRes == nullptr) {
+        return false;
+    }
+    SmartMeterCumulativeUnit::type cumulativeUnit;
+    if (!SmartMeterCumulativeUnit::decode(EchonetLiteFrame(unitRes->data(), unitRes->size()), cumulativeUnit)) {
+        _lastError = SmartMeterError(SmartMeterError::INVALID_RESPONSE);
+        return false;
+    }
+    _scale.pow = (int8_t) smartMeterCumulativePow(cumulativeUnit);
+
+    // 係数 is optional (1 if not supported)
+    static constexpr EchonetLiteGetRequest<SmartMeterCoefficient::epc> COEFFICIENT_REQUEST{};
+    auto coefficientRequest = COEFFICIENT_REQUEST;
+    auto coefficientRes = _request(coefficientRequest.getData(), coefficientRequest.getSize(), 0x72);
+    SmartMeterCoefficient::type coefficient = 1;
+    if (coefficientRes != nullptr) {
+        SmartMeterCoefficient::decode(EchonetLiteFrame(coefficientRes->data(), coefficientRes->size()), coefficient);
+    } else if (!_lastError.isRefused()) {
+        return false;
+    }
+    _scale.coefficient = SmartMeterCoefficient::isValid(coefficient) ? coefficient : 1;
+
+    // 積算電力量有効桁数 (the counter wraps around at 10^digits)
+    static constexpr EchonetLiteGetRequest<SmartMeterEffectiveDigits::epc> DIGITS_REQUEST{};
+    auto digitsRequest = DIGITS_REQUEST;
+    auto digitsRes = _request(digitsRequest.getData(), digitsRequest.getSize(), 0x72);
+    SmartMeterEffectiveDigits::type digits = 8;
+    if (digitsRes != nullptr) {
+        SmartMeterEffectiveDigits::decode(EchonetLiteFrame(digitsRes->data(), digitsRes->size()), digits);
+    } else if (!_lastError.isRefused()) {
+        return false;
+    }
+    _scale.digits = SmartMeterEffectiveDigits::isValid(digits) ? digits : 8;
+    _hasScale = true;
+
+    Serial.printf("Energy scale: %u x 10^%d kWh (%d digits)\n", _scale.coefficient, _scale.pow, _scale.digits);
+    return true;
+}
+
+/**
+ * プロパティマップを取得
+ *
+ * Property maps are read once per meter and cached in NVS, so that reconnects skip the discovery.
+ * Without property maps, unsupported EPCs are learned from SNA responses instead.
+ */
+void SmartMeterClient::_getPropertyMaps() {
+    auto meterAddress = _wisun->getMeterAddress();
+    if (_hasPropertyMaps && _meterAddress.equalsIgnoreCase(meterAddress)) {
+        return;
+    }
+    if (_loadPropertyMaps(meterAddress)) {
+        return;
+    }
+    _hasPropertyMaps = false;
+    _unsupported.reset();
+
+    static constexpr EchonetLiteGetRequest<
+            EchonetLitePropertyMap::EPC_INF,
+            EchonetLitePropertyMap::EPC_SET,
+            EchonetLitePropertyMap::EPC_GET
+    > REQUEST{};
+    auto request = REQUEST;
+    auto res = _request(request.getData(), request.getSize(), 0x72);
+    if (res == nullptr) {
+        Serial.printf("WARN: Failed to get property maps: %s\n", _lastError.toString().c_str());
+        return;
+    }
+    EchonetLiteFrame frame(res->data(), res->size());
+    EchonetLiteProperty infMap{}, setMap{}, getMap{};
+    if (!frame.find(EchonetLitePropertyMap::EPC_INF, infMap) || !_infMap.decode(infMap)
+        || !frame.find(EchonetLitePropertyMap::EPC_SET, setMap) || !_setMap.decode(setMap)
+        || !frame.find(EchonetLitePropertyMap::EPC_GET, getMap) || !_getMap.decode(getMap)) {
+        Serial.println("WARN: Invalid property maps");
+        return;
+    }
+    _meterAddress = meterAddress;
+    _hasPropertyMaps = true;
+    Serial.printf("Property maps: INF=%s, Set=%s, Get=%s\n",
+                  hexString(infMap.edt, infMap.pdc).c_str(),
+                  hexString(setMap.edt, setMap.pdc).c_str(),
+                  hexString(getMap.edt, getMap.pdc).c_str());
+    _savePropertyMaps();
+}
+
+/**
+ * Load property maps from NVS
+ *
+ * @param meterAddress MAC address of the connected meter
+ * @return true:loaded, false:not cached for the meter
+ */
+bool SmartMeterClient::_loadPropertyMaps(const String &meterAddress) {
+    smart_meter_property_maps_t cache{};
+    if (meterAddress.length() == 0 || !nvsLoadBytes(PROPERTY_MAPS_KEY, &cache, sizeof(cache))) {
+        return false;
+    }
+    cache.meterAddress[sizeof(cache.meterAddress) - 1] = '\0';
+    if (!meterAddress.equalsIgnoreCase(cache.meterAddress)) {
+        return false;
+    }
+    _infMap.setData(cache.infMap);
+    _setMap.setData(cache.setMap);
+    _getMap.setData(cache.getMap);
+    _meterAddress = meterAddress;
+    _hasPropertyMaps = true;
+    _unsupported.reset();
+    return true;
+}
+
+/**
+ * Save property maps to NVS
+ */
+void SmartMeterClient::_savePropertyMaps() const {
+    smart_meter_property_maps_t cache{};
+    strncpy(cache.meterAddress, _meterAddress.c_str(), sizeof(cache.meterAddress) - 1);
+    memcpy(cache.infMap, _infMap.getData(), sizeof(cache.infMap));
+    memcpy(cache.setMap, _setMap.getData(), sizeof(cache.setMap));
+    memcpy(cache.getMap, _getMap.getData(), sizeof(cache.getMap));
+    nvsSaveBytes(PROPERTY_MAPS_KEY, &cache, sizeof(cache));
+}
+
+/**
+ * Check if the meter refuses the property
+ *
+ * @param esv ESV of the request
  * @param epc EPC
- * @return プロパティ値
- */
-std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-SmartMeterClient::_recvProperty(uint8_t reqEsv, int timeout) {
-    // Receive response
-    std::unique_ptr<std::vector<uint8_t>> data = nullptr;
-    auto start = millis();
-    while (millis() - start < timeout) {
-        data = _wisun->receiveData(timeout - (int) (millis() - start));
-        if (data == nullptr || data->size() < 12) {
-            return nullptr;
+ * @return true:unsupported
+ */
+bool SmartMeterClient::_isUnsupported(uint8_t esv, uint8_t epc) const {
+    if (_unsupported[epc]) {
+        return true;
+    }
+    if (!_hasPropertyMaps) {
+        return false;
+    }
+    // 0x62: Get, 0x61: SetC
+    return !(esv == 0x62 ? _getMap : _setMap).has(epc);
+}
+
+/**
+ * リクエスト送信
+ *
+ * Registers the request to the request table and returns without waiting for the response.
+ * Unsupported EPCs are dropped from Get requests, other requests including them fail.
+ *
+ * @param frame request frame (TID and properties are patched)
+ * @param frameLen request frame length
+ * @param resEsv expected ESV
+ * @param timestamp context of the request
+ * @return ticket (-1:failure)
+ */
+int SmartMeterClient::_submit(uint8_t *frame, size_t frameLen, uint8_t resEsv, time_t timestamp) {
+    std::vector<uint8_t> unsupported;
+    for (const auto &prop: EchonetLiteFrame(frame, frameLen)) {
+        if (_isUnsupported(frame[10], prop.epc)) {
+            unsupported.push_back(prop.epc);
         }
-        uint16_t tid = data->at(2) << 8 | data->at(3);
-        if (tid == _tid) {
+    }
+    if (!unsupported.empty()) {
+        // 0x62: Get
+        if (frame[10] != 0x62 || unsupported.size() >= frame[11]) {
+            _lastError = SmartMeterError(SmartMeterError::UNSUPPORTED, 0, std::move(unsupported));
+            return -1;
+        }
+        frameLen = _dropUnsupported(frame, frameLen);
+    }
+    EchonetLiteFrame request(frame, frameLen);
+
+    int ticket = -1;
+    for (int i = 0; i < MAX_PENDING; i++) {
+        if (!_pending[i].active) {
+            ticket = i;
             break;
         }
     }
-    auto esv = data->at(10);
-    if (esv != reqEsv) {
-        return nullptr;
+    if (ticket < 0) {
+        Serial.println("ERROR: Too many outstanding requests");
+        _lastError = SmartMeterError(SmartMeterError::BUSY);
+        return -1;
     }
 
-    // Read response
-    auto result = std::make_unique<std::map<uint8_t, std::vector<uint8_t>>>();
-    int idx = 11;
-    int opc = (int) data->at(idx++); // OPC
-    for (int i = 0; i < opc; i++) {
-        auto epc = data->at(idx++); // EPC
-        auto pdc = (int) data->at(idx++); // PDC
-        auto value = std::vector<uint8_t>();
-        for (int j = 0; j < pdc; j++) {
-            value.push_back(data->at(idx++));
+    _tid++;
+    frame[2] = (uint8_t) ((_tid >> 8) & 0xff);
+    frame[3] = (uint8_t) (_tid & 0xff);
+    if (!_wisun->sendData(frame, frameLen, 5000)) {
+        _lastError = SmartMeterError(SmartMeterError::SEND_FAILED);
+        if (_state == STATE_CONNECTED) {
+            _onLinkFailure();
         }
-        result->emplace(epc, std::move(value));
+        return -1;
+    }
+
+    auto &pending = _pending[ticket];
+    pending.active = true;
+    pending.tid = _tid;
+    pending.resEsv = resEsv;
+    pending.sentAt = millis();
+    pending.attempts = 1;
+    pending.frame.assign(frame, frame + frameLen);
+    pending.requestClass = _getRequestClass(request);
+    pending.reqEsv = request.getEsv();
+    pending.timeout = _rtt[pending.requestClass].getTimeout();
+    pending.timestamp = timestamp;
+    pending.response = nullptr;
+    return ticket;
+}
+
+/**
+ * Receive a frame and hand it to the outstanding request with the same TID
+ *
+ * @param timeout timeout (milliseconds)
+ * @return true:received, false:timeout
+ */
+bool SmartMeterClient::_dispatch(int timeout) {
+    auto data = _wisun->receiveData(timeout);
+    if (data == nullptr) {
+        return false;
+    }
+    EchonetLiteFrame frame(data->data(), data->size());
+    if (!frame.isValid()) {
+        return true;
     }
 #if 0
-    for (const auto &r: *result) {
-        Serial.printf("Property: %02x, value: ", r.first);
-        for (const auto &v: r.second) {
-            Serial.printf("%02x", v);
-        }
-        Serial.println();
+    for (const auto &prop: frame) {
+        Serial.printf("Property: %02x, value: %s\n", prop.epc, hexString(prop.edt, prop.pdc).c_str());
     }
 #endif
-    return result;
+    // 0x73: INF, 0x74: INFC
+    if (frame.getEsv() == 0x73 || frame.getEsv() == 0x74) {
+        _onNotification(frame);
+        return true;
+    }
+    for (auto &pending: _pending) {
+        if (pending.active && pending.response == nullptr && pending.tid == frame.getTid()) {
+            pending.response = std::move(data);
+            pending.receivedAt = millis();
+            break;
+        }
+    }
+    return true;
 }
 
 /**
- * プロパティ値読み出し
+ * Handle notification (INF / INFC)
  *
- * @param epc EPC
- * @return EPC, プロパティ値
- */
-std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-SmartMeterClient::_getProperty(const std::vector<uint8_t> &epcs) {
-    static uint8_t header[] = {
-            0x10,  // EHD1
-            0x81,  // EHD2
-            0x00, 0x00,   // TID
-            0x05, 0xff, 0x01,  // SEOJ: Controller
-            0x02, 0x88, 0x01,  // DEOJ: Smart meter
-            0x62,  // ESV: Get
-    };
-    auto sendLen = sizeof(header) + 1 + epcs.size() * 2;
-    auto sendBuf = std::unique_ptr<uint8_t>(new uint8_t[sendLen]);
-    auto pBuf = sendBuf.get();
-    memcpy(pBuf, header, sizeof(header));
-    _tid++;
-    pBuf[2] = (uint8_t) ((_tid >> 8) & 0xff);
-    pBuf[3] = (uint8_t) (_tid & 0xff);
-    pBuf += sizeof(header);
-    *(pBuf++) = epcs.size(); // OPC
-    for (auto epc: epcs) {
-        *(pBuf++) = epc;
-        *(pBuf++) = 0x00;
-    }
-    if (!_wisun->sendData(sendBuf.get(), (int) sendLen, 5000)) {
-        return nullptr;
+ * @param frame received frame
+ */
+void SmartMeterClient::_onNotification(const EchonetLiteFrame &frame) {
+    if (frame.getEsv() == 0x74) {
+        // 0x7A: INFC_Res
+        uint8_t res[EchonetLiteFrame::HEADER_SIZE + 2 * 255];
+        memcpy(res, frame.getData(), 4);  // EHD, TID
+        memcpy(&res[4], frame.getData() + 7, 3);  // SEOJ <- DEOJ
+        memcpy(&res[7], frame.getData() + 4, 3);  // DEOJ <- SEOJ
+        res[10] = 0x7a;
+        res[11] = frame.getOpc();
+        size_t resLen = EchonetLiteFrame::HEADER_SIZE;
+        for (const auto &prop: frame) {
+            res[resLen++] = prop.epc;
+            res[resLen++] = 0x00;
+        }
+        _wisun->sendData(res, resLen, 5000);
+    }
+    if (frame.getSeoj() != 0x028801 || !_hasScale || !_notificationListener) {
+        return;
     }
 
-    // 0x72: Get_Res
-    return _recvProperty(0x72, _getTimeout(epcs));
+    // 定時積算電力量 (正方向 / 逆方向) of the same time are notified as one value
+    std::unique_ptr<MeterValue> fixedTime;
+    auto flushFixedTime = [&](time_t timestamp) {
+        if (fixedTime != nullptr && fixedTime->getTimestamp() != timestamp) {
+            _notificationListener(*fixedTime);
+            fixedTime = nullptr;
+        }
+        if (fixedTime == nullptr) {
+            fixedTime = std::make_unique<MeterValue>(timestamp);
+        }
+    };
+    for (const auto &prop: frame) {
+        if (prop.epc == SmartMeterFixedTimeCumulativeForward::epc) {
+            time_t timestamp;
+            SmartMeterCumulativeForward::type cumulative;
+            if (SmartMeterFixedTimeCumulativeForward::decode(prop, timestamp, cumulative)) {
+                flushFixedTime(timestamp);
+                fixedTime->setCumulative(cumulative, _scale);
+            }
+        } else if (prop.epc == SmartMeterFixedTimeCumulativeReverse::epc) {
+            time_t timestamp;
+            SmartMeterCumulativeReverse::type cumulativeReverse;
+            if (SmartMeterFixedTimeCumulativeReverse::decode(prop, timestamp, cumulativeReverse)) {
+                flushFixedTime(timestamp);
+                fixedTime->setCumulativeReverse(cumulativeReverse, _scale);
+            }
+        } else if (prop.epc == SmartMeterInstantaneousPower::epc) {
+            SmartMeterInstantaneousPower::type instantaneous;
+            if (SmartMeterInstantaneousPower::decode(prop, instantaneous)) {
+                MeterValue value(time(nullptr));
+                value.setInstantaneous(instantaneous);
+                _notificationListener(value);
+            }
+        }
+    }
+    if (fixedTime != nullptr) {
+        _notificationListener(*fixedTime);
+    }
 }
 
 /**
- * プロパティ値書き込み
+ * Wait for the response of the outstanding request
+ *
+ * Responses of other outstanding requests received meanwhile are kept for them.
  *
- * @param epc EPC, プロパティ値
- * @return EPC, プロパティ値
+ * @param ticket ticket returned by _submit()
+ * @return received frame (nullptr:failure)
  */
-std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-SmartMeterClient::_setProperty(const std::map<uint8_t, std::vector<uint8_t>> &props) {
-    static uint8_t header[] = {
-            0x10,  // EHD1
-            0x81,  // EHD2
-            0x00, 0x00,   // TID
-            0x05, 0xff, 0x01,  // SEOJ: Controller
-            0x02, 0x88, 0x01,  // DEOJ: Smart meter
-            0x61,  // ESV: SetC
-    };
-    auto sendLen = sizeof(header) + 1;
-    for (const auto &prop: props) {
-        sendLen += 2 + prop.second.size();
+std::unique_ptr<std::vector<uint8_t>> SmartMeterClient::_await(int ticket) {
+    if (ticket < 0) {
+        return nullptr;
     }
-    auto sendBuf = std::unique_ptr<uint8_t>(new uint8_t[sendLen]);
-    auto pBuf = sendBuf.get();
-    memcpy(pBuf, header, sizeof(header));
-    _tid++;
-    pBuf[2] = (uint8_t) ((_tid >> 8) & 0xff);
-    pBuf[3] = (uint8_t) (_tid & 0xff);
-    pBuf += sizeof(header);
-    *(pBuf++) = props.size(); // OPC
-    for (const auto &prop: props) {
-        *(pBuf++) = prop.first;
-        *(pBuf++) = prop.second.size();
-        for (const auto &v: prop.second) {
-            *(pBuf++) = v;
+    auto &pending = _pending[ticket];
+    while (pending.response == nullptr) {
+        auto elapsed = (int) (millis() - pending.sentAt);
+        if (elapsed >= pending.timeout) {
+            if (pending.attempts >= _maxAttempts) {
+                break;
+            }
+            _retransmit(pending);
+            continue;
+        }
+        _dispatch(pending.timeout - elapsed);
+    }
+    pending.active = false;
+    auto data = std::move(pending.response);
+    if (data == nullptr) {
+        Serial.printf("Timeout: TID=%04x (%d attempts)\n", pending.tid, pending.attempts);
+        _rtt[pending.requestClass].backoff();
+        _wisun->getLinkQuality().onTimeout();
+        _lastError = SmartMeterError(SmartMeterError::TIMEOUT);
+        if (_state == STATE_CONNECTED) {
+            _onLinkFailure();
         }
+        return nullptr;
+    }
+    if (pending.attempts == 1) {
+        _rtt[pending.requestClass].update((int) (pending.receivedAt - pending.sentAt));
+    } else {
+        // Karn's algorithm: the response cannot be attributed to one of the transmissions, so no RTT sample
+        _wisun->getLinkQuality().onRecovered();
     }
-    if (!_wisun->sendData(sendBuf.get(), (int) sendLen, 5000)) {
+    // any response (even SNA) proves the link
+    _recovery.onSuccess();
+    EchonetLiteFrame frame(data->data(), data->size());
+    if (frame.getEsv() != pending.resEsv) {
+        // 0x5x: SNA for the request 0x6x
+        if (frame.getEsv() == pending.reqEsv - 0x10) {
+            _onRejected(pending.reqEsv, frame);
+            // 0x52: Get_SNA still carries the accepted properties
+            if (pending.reqEsv == 0x62 && _hasAcceptedProperty(frame)) {
+                return data;
+            }
+        } else {
+            _lastError = SmartMeterError(SmartMeterError::INVALID_RESPONSE, frame.getEsv());
+        }
         return nullptr;
     }
+    _onAccepted(frame);
+    _lastError = SmartMeterError();
+    return data;
+}
 
-    // 0x71: Set_Res
-    std::vector<uint8_t> epcs;
-    for (const auto &prop: props) {
-        epcs.push_back(prop.first);
+/**
+ * Handle SNA response
+ *
+ * EPCs refused MAX_REFUSALS times in a row are remembered as unsupported so that they are not requested again
+ * until rejoin, even if the property maps say otherwise. Mandatory EPCs are never given up.
+ *
+ * @param reqEsv ESV of the request
+ * @param response SNA response
+ */
+void SmartMeterClient::_onRejected(uint8_t reqEsv, const EchonetLiteFrame &response) {
+    std::vector<uint8_t> refused;
+    for (const auto &prop: response) {
+        // Get_SNA: refused properties have no EDT, SetC_SNA: refused properties are returned with EDT
+        bool isRefused = reqEsv == 0x62 ? prop.pdc == 0 : prop.pdc != 0;
+        if (isRefused) {
+            refused.push_back(prop.epc);
+            if (!_isMandatory(prop.epc) && _refusals[prop.epc] < MAX_REFUSALS
+                && ++_refusals[prop.epc] == MAX_REFUSALS) {
+                Serial.printf("EPC %02X is unsupported\n", prop.epc);
+                _unsupported[prop.epc] = true;
+            }
+        } else {
+            _refusals[prop.epc] = 0;
+        }
+    }
+    _lastError = SmartMeterError(SmartMeterError::REJECTED, response.getEsv(), std::move(refused));
+    Serial.printf("Rejected: %s\n", _lastError.toString().c_str());
+}
+
+/**
+ * Reset refusals of the properties in the response
+ *
+ * @param response response
+ */
+void SmartMeterClient::_onAccepted(const EchonetLiteFrame &response) {
+    for (const auto &prop: response) {
+        _refusals[prop.epc] = 0;
+    }
+}
+
+/**
+ * Check if the property is mandatory for low-voltage smart electric energy meter
+ *
+ * Refusals of these are regarded as transient.
+ */
+bool SmartMeterClient::_isMandatory(uint8_t epc) {
+    return epc == SmartMeterInstantaneousPower::epc
+           || epc == SmartMeterCumulativeForward::epc
+           || epc == SmartMeterCumulativeUnit::epc
+           || epc == SmartMeterEffectiveDigits::epc
+           || epc == SmartMeterCumulativeHistoryForward::epc
+           || epc == SmartMeterHistoryCollectionDay::epc;
+}
+
+/**
+ * Remove unsupported properties from Get request in place
+ *
+ * @param frame Get request frame (OPC is patched)
+ * @param frameLen request frame length
+ * @return new request frame length
+ */
+size_t SmartMeterClient::_dropUnsupported(uint8_t *frame, size_t frameLen) const {
+    size_t opc = 0;
+    size_t offset = EchonetLiteFrame::HEADER_SIZE;
+    for (const auto &prop: EchonetLiteFrame(frame, frameLen)) {
+        if (_isUnsupported(frame[10], prop.epc)) {
+            continue;
+        }
+        // PDC is 0 for Get
+        frame[offset++] = prop.epc;
+        frame[offset++] = 0x00;
+        opc++;
     }
-    return _recvProperty(0x71, _getTimeout(epcs));
+    frame[11] = (uint8_t) opc;
+    return offset;
 }
 
-int SmartMeterClient::_getTimeout(const std::vector<uint8_t> &epcs) {
-    if (epcs.size() > 1) {
-        return 60000;
+/**
+ * Check if SNA response carries any accepted property
+ */
+bool SmartMeterClient::_hasAcceptedProperty(const EchonetLiteFrame &response) {
+    for (const auto &prop: response) {
+        if (prop.pdc != 0) {
+            return true;
+        }
     }
-    for (const auto epc: epcs) {
-        if (epc == 0xe2 || epc == 0xe4 || epc == 0xec) {
-            return 60000;
+    return false;
+}
+
+/**
+ * リクエスト送信して応答を待つ
+ *
+ * @param frame request frame (TID is patched)
+ * @param frameLen request frame length
+ * @param resEsv expected ESV
+ * @return received frame (nullptr:failure)
+ */
+std::unique_ptr<std::vector<uint8_t>> SmartMeterClient::_request(uint8_t *frame, size_t frameLen, uint8_t resEsv) {
+    return _await(_submit(frame, frameLen, resEsv));
+}
+
+/**
+ * Classify request by expected response time
+ *
+ * Only history properties make the response large: a Get of several scalar properties (measurement) is as fast as
+ * a single one, and sharing the estimator with history would inflate its timeout.
+ *
+ * @param request request frame
+ * @return request class
+ */
+SmartMeterClient::RequestClass SmartMeterClient::_getRequestClass(const EchonetLiteFrame &request) {
+    for (const auto &prop: request) {
+        if (prop.epc == SmartMeterCumulativeHistoryForward::epc
+            || prop.epc == SmartMeterCumulativeHistoryReverse::epc
+            || prop.epc == SmartMeterCumulativeHistory2::epc) {
+            return REQUEST_CLASS_LARGE;
         }
     }
-    return 20000;
+    return REQUEST_CLASS_SMALL;
 }
@@ -1,46 +1,293 @@
 #if !defined(LIB_SMART_METER_CLIENT_H)
 #define LIB_SMART_METER_CLIENT_H
 
-#include <map>
+#include <atomic>
+#include <bitset>
+#include <deque>
+#include <functional>
 #include <utility>
 
+#include "lib/LinkRecovery.h"
 #include "lib/MeterValue.h"
+#include "lib/RttEstimator.h"
+#include "lib/SmartMeterError.h"
+#include "lib/SmartMeterFuture.h"
+#include "lib/echonet/EchonetLiteFrame.h"
+#include "lib/echonet/EchonetLitePropertyMap.h"
+#include "lib/echonet/EchonetLiteRequest.h"
+#include "lib/echonet/SmartMeterProperty.h"
 #include "lib/wisun/WiSUN.h"
 
+/**
+ * Smart meter client
+ *
+ * The synchronous API (connect, get*, request* / receive*, poll) must be called from one task.
+ * After begin(), the I/O task owns the Wi-SUN module and only the asynchronous API (*Async) may be used
+ * from other tasks.
+ */
 class SmartMeterClient {
 public:
+    typedef enum {
+        /// I/O task is not started
+        STATE_IDLE = 0,
+        /// Connecting to the meter
+        STATE_CONNECTING,
+        /// Connected
+        STATE_CONNECTED,
+        /// PANA session is being re-authenticated (requests are held)
+        STATE_REAUTHENTICATING,
+        /// Link is lost and waiting for the recovery (requests are held)
+        STATE_DISCONNECTED,
+        /// Failed to recover the link (reboot required)
+        STATE_FAILED,
+    } State;
+
     explicit SmartMeterClient(std::unique_ptr<WiSUN> wisun, String brouteId, String broutePassword)
             : _wisun(std::move(wisun)), _brouteId(std::move(brouteId)), _broutePassword(std::move(broutePassword)) {};
 
     bool connect();
 
+    void begin();
+
+    State getState() const { return _state.load(); }
+
+    LinkQuality::Stats getLinkStats() const;
+
+    /** Phase of join sequence (readable from any task) */
+    WiSUN::JoinPhase getJoinPhase() const { return _wisun->getJoinPhase(); }
+
+    /** Steps done in the current phase of join sequence */
+    int getJoinSteps() const { return _wisun->getJoinSteps(); }
+
+    void setRetransmission(int maxAttempts, int maxInterval);
+
+    /** Recovery ladder of the link (owned by the I/O task) */
+    const LinkRecovery &getRecovery() const { return _recovery; }
+
+    SmartMeterFuture<MeterValue> getMeterValueAsync(SmartMeterFuture<MeterValue>::Callback callback = nullptr);
+
+    SmartMeterFuture<std::vector<MeterValue>> getMeterHistoryAsync(
+            int day, SmartMeterFuture<std::vector<MeterValue>>::Callback callback = nullptr);
+
+    SmartMeterFuture<std::vector<MeterValue>> getMeterHistory2Async(
+            time_t latest, int count, SmartMeterFuture<std::vector<MeterValue>>::Callback callback = nullptr);
+
     std::unique_ptr<MeterValue> getMeterValue();
 
     std::unique_ptr<std::vector<MeterValue>> getMeterHistory(int day);
 
+    int requestMeterValue();
+
+    std::unique_ptr<MeterValue> receiveMeterValue(int ticket);
+
+    int requestMeterHistory(int day);
+
+    std::unique_ptr<std::vector<MeterValue>> receiveMeterHistory(int ticket);
+
+    std::unique_ptr<std::vector<MeterValue>> getMeterHistory2(time_t latest, int count);
+
+    int requestMeterHistory2(time_t latest, int count);
+
+    std::unique_ptr<std::vector<MeterValue>> receiveMeterHistory2(int ticket);
+
+    void setNotificationListener(std::function<void(const MeterValue &)> listener) {
+        _notificationListener = std::move(listener);
+    }
+
+    void poll(int timeout);
+
+    /** Error of the last completed request */
+    const SmartMeterError &getLastError() const { return _lastError; }
+
 private:
     std::unique_ptr<WiSUN> _wisun;
     String _brouteId;
     String _broutePassword;
 
-    /// Cumulative power
-    std::unique_ptr<int> _cumulativePow;
+    /// Scale of cumulative energy (resolved on connect)
+    SmartMeterEnergyScale _scale;
+
+    /// Scale has been resolved
+    bool _hasScale = false;
 
     /// TID
     uint16_t _tid = 0;
 
-    std::unique_ptr<int> _getMeterCumulativePow();
+    /**
+     * Request class for response time estimation
+     */
+    typedef enum {
+        /// Scalar properties only
+        REQUEST_CLASS_SMALL = 0,
+        /// Including history
+        REQUEST_CLASS_LARGE,
+        REQUEST_CLASS_MAX,
+    } RequestClass;
+
+    /// Response time estimators per request class (upper bounds: 20 s / 60 s)
+    RttEstimator _rtt[REQUEST_CLASS_MAX] = {RttEstimator(2000, 20000), RttEstimator(5000, 60000)};
+
+    /// Maximum number of outstanding requests
+    static const int MAX_PENDING = 4;
+
+    /// Attempts of a request including the first transmission
+    int _maxAttempts = 3;
+
+    /// Upper bound of the retransmission interval (milliseconds)
+    int _maxRetransmitInterval = 8000;
+
+    /**
+     * Outstanding request
+     */
+    struct PendingRequest {
+        bool active = false;
+        uint16_t tid = 0;
+        uint8_t resEsv = 0;
+        /// Time of the last (re)transmission
+        unsigned long sentAt = 0;
+        unsigned long receivedAt = 0;
+        /// Transmissions so far
+        int attempts = 0;
+        /// Request frame kept for retransmission (same TID)
+        std::vector<uint8_t> frame;
+        RequestClass requestClass = REQUEST_CLASS_SMALL;
+        /// ESV of the request
+        uint8_t reqEsv = 0;
+        /// Time to wait after the last (re)transmission (milliseconds)
+        int timeout = 0;
+        /// Measured time or start of history
+        time_t timestamp = 0;
+        std::unique_ptr<std::vector<uint8_t>> response;
+    };
+
+    /// Request table
+    PendingRequest _pending[MAX_PENDING];
+
+    /// Error of the last completed request
+    SmartMeterError _lastError;
+
+    /// EPCs the meter does not support (learned from SNA responses, forgotten on rejoin)
+    std::bitset<256> _unsupported;
+
+    /// Consecutive refusals per EPC
+    uint8_t _refusals[256] = {};
+
+    /// Refusals before an EPC is regarded as unsupported (a single SNA may be transient)
+    static const uint8_t MAX_REFUSALS = 3;
+
+    /// MAC address of the meter the property maps belong to
+    String _meterAddress;
+
+    /// Property maps have been resolved
+    bool _hasPropertyMaps = false;
+
+    /// 状変アナウンスプロパティマップ
+    EchonetLitePropertyMap _infMap;
+
+    /// Set プロパティマップ
+    EchonetLitePropertyMap _setMap;
+
+    /// Get プロパティマップ
+    EchonetLitePropertyMap _getMap;
+
+    /// Listener of values notified by the meter
+    std::function<void(const MeterValue &)> _notificationListener;
+
+    /**
+     * Command to the I/O task
+     */
+    struct Command {
+        /// Submit the request (returns ticket)
+        std::function<int()> submit;
+        /// Receive the response and resolve the future
+        std::function<void(int ticket)> complete;
+        int ticket;
+        /// Error of submission (ticket < 0)
+        SmartMeterError error;
+        /// Submit the next request from the response of the first one (returns ticket, optional)
+        std::function<int(int ticket)> then;
+    };
+
+    /// Maximum number of queued commands
+    static const int MAX_COMMANDS = 8;
+
+    /// Command queue (Command *)
+    QueueHandle_t _commands = nullptr;
+
+    /// Commands submitted by the I/O task
+    std::deque<Command *> _inFlight;
+
+    /// Connection state
+    std::atomic<State> _state{STATE_IDLE};
+
+    /// Recovery ladder of the link
+    LinkRecovery _recovery;
+
+    TaskHandle_t _taskHandle = nullptr;
+
+    void _run();
+
+    void _updateSessionState();
+
+    void _recover(LinkRecovery::Action action);
+
+    void _reconnect(WiSUN::ConnectMode mode);
+
+    void _abortInFlight();
+
+    void _complete(Command *command);
+
+    void _onLinkFailure(LinkRecovery::Action atLeast = LinkRecovery::ACTION_RETRY);
+
+    bool _post(Command *command);
+
+    bool _isDone(int ticket) const;
+
+    void _retransmit(PendingRequest &pending);
+
+    void _retransmitDue();
+
+    bool _onConnected();
+
+    bool _getEnergyScale();
+
+    void _getPropertyMaps();
+
+    bool _loadPropertyMaps(const String &meterAddress);
+
+    void _savePropertyMaps() const;
+
+    bool _isUnsupported(uint8_t esv, uint8_t epc) const;
+
+    int _submit(uint8_t *frame, size_t frameLen, uint8_t resEsv, time_t timestamp = 0);
+
+    int _submitHistoryDay(int day);
+
+    int _submitHistory(int setTicket);
+
+    int _submitHistory2DateTime(time_t latest, int count);
+
+    int _submitHistory2(int setTicket);
+
+    bool _dispatch(int timeout);
+
+    std::unique_ptr<std::vector<uint8_t>> _await(int ticket);
+
+    void _onNotification(const EchonetLiteFrame &frame);
+
+    void _onRejected(uint8_t reqEsv, const EchonetLiteFrame &response);
+
+    void _onAccepted(const EchonetLiteFrame &response);
+
+    static bool _isMandatory(uint8_t epc);
 
-    std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-    _recvProperty(uint8_t reqEsv, int timeout);
+    size_t _dropUnsupported(uint8_t *frame, size_t frameLen) const;
 
-    std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-    _getProperty(const std::vector<uint8_t> &epcs);
+    static bool _hasAcceptedProperty(const EchonetLiteFrame &response);
 
-    std::unique_ptr<std::map<uint8_t, std::vector<uint8_t>>>
-    _setProperty(const std::map<uint8_t, std::vector<uint8_t>> &props);
+    std::unique_ptr<std::vector<uint8_t>> _request(uint8_t *frame, size_t frameLen, uint8_t resEsv);
 
-    int _getTimeout(const std::vector<uint8_t> &epcs);
+    static RequestClass _getRequestClass(const EchonetLiteFrame &request);
 };
 
 #endif // !defined(LIB_SMART_METER_CLIENT_H)
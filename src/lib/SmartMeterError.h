@@ -0,0 +1,71 @@
+#if !defined(LIB_SMART_METER_ERROR_H)
+#define LIB_SMART_METER_ERROR_H
+
+#include <vector>
+#include <Arduino.h>
+
+/**
+ * Error of smart meter request
+ */
+class SmartMeterError {
+public:
+    typedef enum {
+        NONE = 0,
+        /// Too many outstanding requests
+        BUSY,
+        /// Failed to send request
+        SEND_FAILED,
+        /// No response
+        TIMEOUT,
+        /// Rejected by the meter (SNA response)
+        REJECTED,
+        /// Not requested because the meter does not support the property
+        UNSUPPORTED,
+        /// Response lacks properties or has invalid values
+        INVALID_RESPONSE,
+        /// Link to the meter was lost while waiting for the response
+        DISCONNECTED,
+    } Code;
+
+    SmartMeterError() = default;
+
+    explicit SmartMeterError(Code code, uint8_t esv = 0, std::vector<uint8_t> epcs = {})
+            : _code(code), _esv(esv), _epcs(std::move(epcs)) {};
+
+    Code getCode() const { return _code; }
+
+    /// ESV of the response (REJECTED)
+    uint8_t getEsv() const { return _esv; }
+
+    /// EPCs refused or not supported by the meter (REJECTED, UNSUPPORTED)
+    const std::vector<uint8_t> &getEpcs() const { return _epcs; }
+
+    /// The meter answered but refused the request
+    bool isRefused() const { return _code == REJECTED || _code == UNSUPPORTED; }
+
+    String toString() const {
+        static const char *names[] = {
+                "NONE", "BUSY", "SEND_FAILED", "TIMEOUT", "REJECTED", "UNSUPPORTED", "INVALID_RESPONSE",
+                "DISCONNECTED",
+        };
+        String str = names[_code];
+        if (_code == REJECTED) {
+            char esv[8];
+            snprintf(esv, sizeof(esv), " %02X", _esv);
+            str += esv;
+        }
+        for (const auto epc: _epcs) {
+            char s[8];
+            snprintf(s, sizeof(s), " %02X", epc);
+            str += s;
+        }
+        return str;
+    }
+
+private:
+    Code _code = NONE;
+    uint8_t _esv = 0;
+    std::vector<uint8_t> _epcs;
+};
+
+#endif // !defined(LIB_SMART_METER_ERROR_H)
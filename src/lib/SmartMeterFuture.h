@@ -0,0 +1,78 @@
+#if !defined(LIB_SMART_METER_FUTURE_H)
+#define LIB_SMART_METER_FUTURE_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <utility>
+
+#include "lib/SmartMeterError.h"
+
+/**
+ * Result of asynchronous smart meter request
+ *
+ * A copyable handle to the shared result. The I/O task resolves it once, and the consumer either polls isReady()
+ * or receives the completion callback (called on the I/O task).
+ *
+ * @tparam T value type
+ */
+template<typename T>
+class SmartMeterFuture {
+public:
+    /** Completion callback (value is nullptr on failure) */
+    typedef std::function<void(const T *value, const SmartMeterError &error)> Callback;
+
+    /** Invalid future (not requested) */
+    SmartMeterFuture() = default;
+
+    explicit SmartMeterFuture(Callback callback) : _state(std::make_shared<State>()) {
+        _state->callback = std::move(callback);
+    };
+
+    /** Requested */
+    bool isValid() const { return _state != nullptr; }
+
+    /** Resolved */
+    bool isReady() const { return _state != nullptr && _state->ready.load(std::memory_order_acquire); }
+
+    /** Value (nullptr:failure), available after isReady() */
+    const T *get() const { return _state->value.get(); }
+
+    /** Move out the value (nullptr:failure), available after isReady() */
+    std::unique_ptr<T> take() { return std::move(_state->value); }
+
+    /** Error, available after isReady() */
+    const SmartMeterError &getError() const { return _state->error; }
+
+    /** Forget the request */
+    void reset() { _state = nullptr; }
+
+    /**
+     * Resolve the future (I/O task)
+     *
+     * The callback runs before the future becomes ready, so that a polling consumer cannot take the value under it.
+     *
+     * @param value value (nullptr:failure)
+     * @param error error
+     */
+    void resolve(std::unique_ptr<T> value, const SmartMeterError &error) const {
+        _state->value = std::move(value);
+        _state->error = error;
+        if (_state->callback) {
+            _state->callback(_state->value.get(), _state->error);
+        }
+        _state->ready.store(true, std::memory_order_release);
+    }
+
+private:
+    struct State {
+        std::atomic<bool> ready{false};
+        std::unique_ptr<T> value;
+        SmartMeterError error;
+        Callback callback;
+    };
+
+    std::shared_ptr<State> _state;
+};
+
+#endif // !defined(LIB_SMART_METER_FUTURE_H)
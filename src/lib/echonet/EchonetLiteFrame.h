@@ -0,0 +1,110 @@
+#if !defined(LIB_ECHONET_ECHONET_LITE_FRAME_H)
+#define LIB_ECHONET_ECHONET_LITE_FRAME_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * ECHONET Lite property (EPC, PDC, EDT)
+ *
+ * EDT points into the received frame and is valid only while the frame buffer lives.
+ */
+struct EchonetLiteProperty {
+    uint8_t epc;
+    uint8_t pdc;
+    const uint8_t *edt;
+};
+
+/**
+ * ECHONET Lite frame view
+ *
+ * Decodes a received frame (specified message format) in place over the buffer without copying.
+ * The buffer must outlive the view. Header accessors are meaningful only when isValid() is true.
+ */
+class EchonetLiteFrame {
+public:
+    /// Size of EHD, TID, SEOJ, DEOJ, ESV and OPC
+    static const size_t HEADER_SIZE = 12;
+
+    /**
+     * Iterator over EPC/PDC/EDT
+     */
+    class Iterator {
+    public:
+        explicit Iterator(const uint8_t *p) : _p(p) {};
+
+        EchonetLiteProperty operator*() const { return {_p[0], _p[1], _p + 2}; }
+
+        Iterator &operator++() {
+            _p += 2 + _p[1];
+            return *this;
+        }
+
+        bool operator!=(const Iterator &other) const { return _p != other._p; }
+
+    private:
+        const uint8_t *_p;
+    };
+
+    EchonetLiteFrame(const uint8_t *data, size_t size) : _data(data), _size(size), _propsEnd(data) {
+        if (size < HEADER_SIZE || data[0] != 0x10 || data[1] != 0x81) {
+            return;
+        }
+        // Check that every property lies within the frame
+        const uint8_t *p = data + HEADER_SIZE;
+        const uint8_t *end = data + size;
+        for (int i = 0; i < data[11]; i++) {
+            if (end - p < 2 || end - p < 2 + p[1]) {
+                return;
+            }
+            p += 2 + p[1];
+        }
+        _propsEnd = p;
+        _valid = true;
+    };
+
+    bool isValid() const { return _valid; }
+
+    const uint8_t *getData() const { return _data; }
+
+    size_t getSize() const { return _size; }
+
+    uint16_t getTid() const { return _data[2] << 8 | _data[3]; }
+
+    uint32_t getSeoj() const { return _data[4] << 16 | _data[5] << 8 | _data[6]; }
+
+    uint32_t getDeoj() const { return _data[7] << 16 | _data[8] << 8 | _data[9]; }
+
+    uint8_t getEsv() const { return _data[10]; }
+
+    uint8_t getOpc() const { return _valid ? _data[11] : 0; }
+
+    Iterator begin() const { return Iterator(_valid ? _data + HEADER_SIZE : _propsEnd); }
+
+    Iterator end() const { return Iterator(_propsEnd); }
+
+    /**
+     * Find property
+     *
+     * @param epc EPC
+     * @param prop found property
+     * @return true:found, false:not found
+     */
+    bool find(uint8_t epc, EchonetLiteProperty &prop) const {
+        for (auto p: *this) {
+            if (p.epc == epc) {
+                prop = p;
+                return true;
+            }
+        }
+        return false;
+    }
+
+private:
+    const uint8_t *_data;
+    size_t _size;
+    const uint8_t *_propsEnd;
+    bool _valid = false;
+};
+
+#endif // !defined(LIB_ECHONET_ECHONET_LITE_FRAME_H)
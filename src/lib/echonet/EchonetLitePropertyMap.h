@@ -0,0 +1,76 @@
+#if !defined(LIB_ECHONET_ECHONET_LITE_PROPERTY_MAP_H)
+#define LIB_ECHONET_ECHONET_LITE_PROPERTY_MAP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "lib/echonet/EchonetLiteFrame.h"
+
+/**
+ * プロパティマップ (0x9D: 状変アナウンス / 0x9E: Set / 0x9F: Get)
+ *
+ * EDT is either a list (count < 16: count + EPCs) or a bitmap (count >= 16: count + 16 bytes).
+ * In the bitmap, bit b of byte i stands for EPC ((b + 8) << 4) | i.
+ */
+class EchonetLitePropertyMap {
+public:
+    /// 状変アナウンスプロパティマップ
+    static constexpr uint8_t EPC_INF = 0x9d;
+    /// Set プロパティマップ
+    static constexpr uint8_t EPC_SET = 0x9e;
+    /// Get プロパティマップ
+    static constexpr uint8_t EPC_GET = 0x9f;
+
+    /// Size of serialized map (one bit per EPC)
+    static constexpr size_t SIZE = 32;
+
+    EchonetLitePropertyMap() : _bits() {};
+
+    bool has(uint8_t epc) const { return (_bits[epc >> 3] & (1 << (epc & 7))) != 0; }
+
+    void set(uint8_t epc) { _bits[epc >> 3] |= (uint8_t) (1 << (epc & 7)); }
+
+    /**
+     * Decode EDT of property map
+     *
+     * @param prop property map
+     * @return true:success, false:malformed
+     */
+    bool decode(const EchonetLiteProperty &prop) {
+        memset(_bits, 0, sizeof(_bits));
+        if (prop.pdc < 1) {
+            return false;
+        }
+        uint8_t count = prop.edt[0];
+        if (count < 16) {
+            if (prop.pdc != 1 + count) {
+                return false;
+            }
+            for (size_t i = 0; i < count; i++) {
+                set(prop.edt[1 + i]);
+            }
+            return true;
+        }
+        if (prop.pdc != 17) {
+            return false;
+        }
+        for (uint8_t i = 0; i < 16; i++) {
+            for (uint8_t b = 0; b < 8; b++) {
+                if (prop.edt[1 + i] & (1 << b)) {
+                    set((uint8_t) (((b + 8) << 4) | i));
+                }
+            }
+        }
+        return true;
+    }
+
+    const uint8_t *getData() const { return _bits; }
+
+    void setData(const uint8_t *data) { memcpy(_bits, data, sizeof(_bits)); }
+
+private:
+    uint8_t _bits[SIZE];
+};
+
+#endif // !defined(LIB_ECHONET_ECHONET_LITE_PROPERTY_MAP_H)
@@ -0,0 +1,139 @@
+#if !defined(LIB_ECHONET_ECHONET_LITE_REQUEST_H)
+#define LIB_ECHONET_ECHONET_LITE_REQUEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+/**
+ * Request property (EPC and EDT length)
+ *
+ * @tparam EPC EPC
+ * @tparam PDC EDT length (0 for Get)
+ */
+template<uint8_t EPC, uint8_t PDC = 0>
+struct EchonetLiteRequestProperty {
+    static constexpr uint8_t epc = EPC;
+    static constexpr uint8_t pdc = PDC;
+};
+
+constexpr size_t echonetLiteSum(std::initializer_list<size_t> values) {
+    size_t sum = 0;
+    for (auto v: values) sum += v;
+    return sum;
+}
+
+/**
+ * Property list of request frame (OPC, EPC, PDC, EDT...)
+ */
+template<typename... Props>
+struct EchonetLiteRequestProperties {
+    static constexpr size_t count = sizeof...(Props);
+
+    /// OPC + (EPC + PDC + EDT) * count
+    static constexpr size_t size = 1 + echonetLiteSum({(size_t) (2 + Props::pdc)...});
+
+    /**
+     * Lay out OPC, EPC and PDC (EDT is left zero)
+     *
+     * @return offset next to the list
+     */
+    static constexpr size_t layout(uint8_t *buf, size_t offset) {
+        const uint8_t epcs[] = {Props::epc..., 0};
+        const uint8_t pdcs[] = {Props::pdc..., 0};
+        buf[offset++] = count;
+        for (size_t i = 0; i < count; i++) {
+            buf[offset++] = epcs[i];
+            buf[offset++] = pdcs[i];
+            offset += pdcs[i];
+        }
+        return offset;
+    }
+
+    /**
+     * Offset of EDT from the top of the list
+     */
+    static constexpr size_t edtOffset(size_t index) {
+        const uint8_t pdcs[] = {Props::pdc..., 0};
+        size_t offset = 1;
+        for (size_t i = 0; i < index; i++) {
+            offset += 2 + pdcs[i];
+        }
+        return offset + 2;
+    }
+};
+
+/**
+ * Absent property list (no OPC)
+ */
+struct EchonetLiteNoProperties {
+    static constexpr size_t count = 0;
+    static constexpr size_t size = 0;
+
+    static constexpr size_t layout(uint8_t *, size_t offset) { return offset; }
+};
+
+/**
+ * ECHONET Lite request frame laid out at compile time
+ *
+ * Declare a template as static constexpr and copy it to the stack, then patch EDT for Set before sending
+ * (TID is assigned when the frame is submitted).
+ *
+ * @tparam ESV ESV
+ * @tparam Props property list
+ * @tparam GetProps property list for Get (SetGet only)
+ */
+template<uint8_t ESV, typename Props, typename GetProps = EchonetLiteNoProperties>
+class EchonetLiteRequest {
+public:
+    /// EHD, TID, SEOJ, DEOJ, ESV
+    static constexpr size_t HEADER_SIZE = 11;
+
+    static constexpr size_t SIZE = HEADER_SIZE + Props::size + GetProps::size;
+
+    constexpr EchonetLiteRequest() : _data() {
+        const uint8_t header[HEADER_SIZE] = {
+                0x10,  // EHD1
+                0x81,  // EHD2
+                0x00, 0x00,   // TID
+                0x05, 0xff, 0x01,  // SEOJ: Controller
+                0x02, 0x88, 0x01,  // DEOJ: Smart meter
+                ESV,  // ESV
+        };
+        for (size_t i = 0; i < HEADER_SIZE; i++) {
+            _data[i] = header[i];
+        }
+        GetProps::layout(_data, Props::layout(_data, HEADER_SIZE));
+    }
+
+    uint8_t *getData() { return _data; }
+
+    static constexpr size_t getSize() { return SIZE; }
+
+    /**
+     * EDT of the I-th property (Set properties for SetGet)
+     */
+    template<size_t I>
+    uint8_t *getEdt() {
+        static_assert(I < Props::count, "property index out of range");
+        return &_data[HEADER_SIZE + Props::edtOffset(I)];
+    }
+
+private:
+    uint8_t _data[SIZE];
+};
+
+/// Get (0x62)
+template<uint8_t... EPCs>
+using EchonetLiteGetRequest = EchonetLiteRequest<
+        0x62, EchonetLiteRequestProperties<EchonetLiteRequestProperty<EPCs>...>>;
+
+/// SetC (0x61)
+template<typename... Props>
+using EchonetLiteSetCRequest = EchonetLiteRequest<0x61, EchonetLiteRequestProperties<Props...>>;
+
+/// SetGet (0x6E)
+template<typename SetProps, typename GetProps>
+using EchonetLiteSetGetRequest = EchonetLiteRequest<0x6e, SetProps, GetProps>;
+
+#endif // !defined(LIB_ECHONET_ECHONET_LITE_REQUEST_H)
@@ -0,0 +1,341 @@
+#if !defined(LIB_ECHONET_SMART_METER_PROPERTY_H)
+#define LIB_ECHONET_SMART_METER_PROPERTY_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <ArduinoJson.h>
+
+#include "lib/echonet/EchonetLiteFrame.h"
+
+/**
+ * Scaling of property value
+ */
+typedef enum {
+    SMART_METER_SCALE_NONE = 0,
+    /// scaled by 積算電力量単位 (0xE1)
+    SMART_METER_SCALE_CUMULATIVE_UNIT,
+} SmartMeterScale;
+
+/**
+ * Big-endian load of N bytes
+ */
+template<size_t N>
+struct SmartMeterBigEndian;
+
+template<>
+struct SmartMeterBigEndian<1> {
+    static uint32_t load(const uint8_t *p) { return p[0]; }
+};
+
+template<>
+struct SmartMeterBigEndian<2> {
+    static uint32_t load(const uint8_t *p) { return p[0] << 8 | p[1]; }
+};
+
+template<>
+struct SmartMeterBigEndian<4> {
+    static uint32_t load(const uint8_t *p) { return (uint32_t) p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3]; }
+};
+
+/**
+ * Scalar property of low-voltage smart electric energy meter (class 0x0288)
+ *
+ * @tparam EPC EPC
+ * @tparam T value type (signedness follows the specification)
+ * @tparam SIZE EDT length
+ * @tparam NO_DATA "no data" sentinel
+ * @tparam MIN minimum valid value
+ * @tparam MAX maximum valid value
+ * @tparam SCALE scaling
+ */
+template<uint8_t EPC, typename T, size_t SIZE, T NO_DATA, T MIN, T MAX, SmartMeterScale SCALE>
+struct SmartMeterProperty {
+    typedef T type;
+    static constexpr uint8_t epc = EPC;
+    static constexpr size_t size = SIZE;
+    static constexpr SmartMeterScale scale = SCALE;
+    static constexpr T maxValue = MAX;
+
+    static T load(const uint8_t *p) { return (T) SmartMeterBigEndian<SIZE>::load(p); }
+
+    static bool isValid(T value) { return value != NO_DATA && MIN <= value && value <= MAX; }
+
+    /**
+     * Decode value at the top of EDT
+     *
+     * @return true:valid value, false:no data or out of range
+     */
+    static bool decode(const uint8_t *edt, T &value) {
+        value = load(edt);
+        return isValid(value);
+    }
+
+    static bool decode(const EchonetLiteProperty &prop, T &value) {
+        return prop.pdc == SIZE && decode(prop.edt, value);
+    }
+
+    static bool decode(const EchonetLiteFrame &frame, T &value) {
+        EchonetLiteProperty prop{};
+        return frame.find(EPC, prop) && decode(prop, value);
+    }
+};
+
+/**
+ * Historical property: fixed header followed by COUNT values of Element
+ *
+ * @tparam EPC EPC
+ * @tparam HEADER header length
+ * @tparam Element element property
+ * @tparam COUNT number of elements
+ */
+template<uint8_t EPC, size_t HEADER, typename Element, size_t COUNT>
+struct SmartMeterHistoryProperty {
+    typedef Element element;
+    static constexpr uint8_t epc = EPC;
+    static constexpr size_t header = HEADER;
+    static constexpr size_t count = COUNT;
+    static constexpr size_t size = HEADER + Element::size * COUNT;
+
+    /**
+     * Find property in the frame
+     *
+     * @return true:found with valid length
+     */
+    static bool find(const EchonetLiteFrame &frame, EchonetLiteProperty &prop) {
+        return frame.find(EPC, prop) && prop.pdc == size;
+    }
+
+    static bool decode(const EchonetLiteProperty &prop, size_t index, typename Element::type &value) {
+        return Element::decode(prop.edt + HEADER + Element::size * index, value);
+    }
+};
+
+/**
+ * Date and time (YYYY MM DD hh mm) of 積算履歴収集日時
+ */
+struct SmartMeterCollectionDateTime {
+    static constexpr size_t size = 6;
+
+    static void encode(uint8_t *p, time_t timestamp) {
+        struct tm tm{};
+        localtime_r(&timestamp, &tm);
+        p[0] = (uint8_t) ((tm.tm_year + 1900) >> 8);
+        p[1] = (uint8_t) ((tm.tm_year + 1900) & 0xff);
+        p[2] = (uint8_t) (tm.tm_mon + 1);
+        p[3] = (uint8_t) tm.tm_mday;
+        p[4] = (uint8_t) tm.tm_hour;
+        p[5] = (uint8_t) tm.tm_min;
+    }
+
+    static bool decode(const uint8_t *p, time_t &timestamp) {
+        struct tm tm{};
+        tm.tm_year = (p[0] << 8 | p[1]) - 1900;
+        tm.tm_mon = p[2] - 1;
+        tm.tm_mday = p[3];
+        tm.tm_hour = p[4];
+        tm.tm_min = p[5];
+        tm.tm_isdst = -1;
+        if (tm.tm_year < 100 || tm.tm_mon < 0 || tm.tm_mon > 11 || tm.tm_mday < 1 || tm.tm_mday > 31
+            || tm.tm_hour > 23 || tm.tm_min > 59) {
+            return false;
+        }
+        timestamp = mktime(&tm);
+        return true;
+    }
+};
+
+/**
+ * Fixed-time property: date and time (YYYY MM DD hh mm ss) followed by a value of Element
+ *
+ * @tparam EPC EPC
+ * @tparam Element element property
+ */
+template<uint8_t EPC, typename Element>
+struct SmartMeterFixedTimeProperty {
+    typedef Element element;
+    static constexpr uint8_t epc = EPC;
+    static constexpr size_t size = 7 + Element::size;
+
+    /**
+     * Decode date and time (local time) and value
+     *
+     * @return true:valid value, false:invalid date and time, no data or out of range
+     */
+    static bool decode(const EchonetLiteProperty &prop, time_t &timestamp, typename Element::type &value) {
+        if (prop.pdc != size) {
+            return false;
+        }
+        const uint8_t *p = prop.edt;
+        if (!SmartMeterCollectionDateTime::decode(p, timestamp) || p[6] > 59) {
+            return false;
+        }
+        timestamp += p[6];
+        return Element::decode(p + 7, value);
+    }
+};
+
+/**
+ * 低圧スマート電力量メータクラス (0x0288) プロパティ定義
+ *
+ * name, EPC, type, size, no data, min, max, scale, unit, JSON key
+ */
+#define SMART_METER_PROPERTIES(X) \
+    X(EffectiveDigits,      0xd7, uint8_t,  1, 0xff,       1,           8,          SMART_METER_SCALE_NONE,            "",    nullptr)         \
+    X(Coefficient,          0xd3, uint32_t, 4, 0xfffffffe, 1,           999999,     SMART_METER_SCALE_NONE,            "",    nullptr)         \
+    X(CumulativeUnit,       0xe1, uint8_t,  1, 0xff,       0x00,        0x0d,       SMART_METER_SCALE_NONE,            "",    nullptr)         \
+    X(CumulativeForward,    0xe0, uint32_t, 4, 0xfffffffe, 0,           99999999,   SMART_METER_SCALE_CUMULATIVE_UNIT, "kWh", "cumulative")    \
+    X(CumulativeReverse,    0xe3, uint32_t, 4, 0xfffffffe, 0,           99999999,   SMART_METER_SCALE_CUMULATIVE_UNIT, "kWh", "cumulativeReverse") \
+    X(InstantaneousPower,   0xe7, int32_t,  4, 0x7ffffffe, -2147483647, 2147483645, SMART_METER_SCALE_NONE,            "W",   "instantaneous") \
+    X(HistoryCollectionDay, 0xe5, uint8_t,  1, 0xff,       0,           99,         SMART_METER_SCALE_NONE,            "",    nullptr)
+
+#define SMART_METER_PROPERTY_DEFINE(name, epc, type, size, noData, minValue, maxValue, scale, unit, key) \
+    struct SmartMeter##name : public SmartMeterProperty<epc, type, size, (type) noData, minValue, maxValue, scale> { \
+        static const char *getUnit() { return unit; } \
+        static const char *getKey() { return key; } \
+    };
+
+SMART_METER_PROPERTIES(SMART_METER_PROPERTY_DEFINE)
+
+#undef SMART_METER_PROPERTY_DEFINE
+
+/// 積算電力量計測値履歴1(正方向計測値): 積算履歴収集日 (2 bytes) + 48 コマ
+typedef SmartMeterHistoryProperty<0xe2, 2, SmartMeterCumulativeForward, 48> SmartMeterCumulativeHistoryForward;
+
+/// 積算電力量計測値履歴1(逆方向計測値): 積算履歴収集日 (2 bytes) + 48 コマ
+typedef SmartMeterHistoryProperty<0xe4, 2, SmartMeterCumulativeReverse, 48> SmartMeterCumulativeHistoryReverse;
+
+/// 定時積算電力量計測値(正方向計測値): 日時 (7 bytes) + 積算電力量
+typedef SmartMeterFixedTimeProperty<0xea, SmartMeterCumulativeForward> SmartMeterFixedTimeCumulativeForward;
+
+/// 定時積算電力量計測値(逆方向計測値): 日時 (7 bytes) + 積算電力量
+typedef SmartMeterFixedTimeProperty<0xeb, SmartMeterCumulativeReverse> SmartMeterFixedTimeCumulativeReverse;
+
+/**
+ * 積算履歴収集日２: 収集日時 + 収集コマ数
+ */
+struct SmartMeterHistoryCollectionDateTime2 {
+    static constexpr uint8_t epc = 0xed;
+    static constexpr size_t size = SmartMeterCollectionDateTime::size + 1;
+    static constexpr int maxCount = 12;
+
+    /**
+     * Encode EDT
+     *
+     * @param edt EDT
+     * @param latest date and time of the latest slot to collect
+     * @param count number of slots (1 - 12)
+     */
+    static void encode(uint8_t *edt, time_t latest, int count) {
+        SmartMeterCollectionDateTime::encode(edt, latest);
+        edt[SmartMeterCollectionDateTime::size] = (uint8_t) count;
+    }
+};
+
+/**
+ * 積算電力量計測値履歴２(正方向、逆方向計測値): 収集日時 + 収集コマ数 + (正方向, 逆方向) * コマ数
+ *
+ * Slots go back in time from the collection date and time.
+ */
+struct SmartMeterCumulativeHistory2 {
+    static constexpr uint8_t epc = 0xec;
+    static constexpr size_t header = SmartMeterHistoryCollectionDateTime2::size;
+    static constexpr size_t slotSize = SmartMeterCumulativeForward::size + SmartMeterCumulativeReverse::size;
+
+    /**
+     * Find property in the frame
+     *
+     * @param latest date and time of the latest slot
+     * @param count number of slots
+     * @return true:found with valid length
+     */
+    static bool find(const EchonetLiteFrame &frame, EchonetLiteProperty &prop, time_t &latest, size_t &count) {
+        if (!frame.find(epc, prop) || prop.pdc < header) {
+            return false;
+        }
+        count = prop.edt[SmartMeterCollectionDateTime::size];
+        return prop.pdc == header + slotSize * count && SmartMeterCollectionDateTime::decode(prop.edt, latest);
+    }
+
+    static bool decodeForward(const EchonetLiteProperty &prop, size_t index, SmartMeterCumulativeForward::type &value) {
+        return SmartMeterCumulativeForward::decode(prop.edt + header + slotSize * index, value);
+    }
+
+    static bool decodeReverse(const EchonetLiteProperty &prop, size_t index, SmartMeterCumulativeReverse::type &value) {
+        return SmartMeterCumulativeReverse::decode(
+                prop.edt + header + slotSize * index + SmartMeterCumulativeForward::size, value);
+    }
+};
+
+/**
+ * Convert 積算電力量単位 (0xE1) to power of 10
+ *
+ * @param unit 積算電力量単位
+ * @return power of 10 (0 for unknown unit)
+ */
+inline int smartMeterCumulativePow(uint8_t unit) {
+    if (unit > 0 && unit <= 4) {
+        return -unit;
+    } else if (unit >= 10 && unit <= 13) {
+        return unit - 9;
+    }
+    return 0;
+}
+
+/**
+ * Scale of cumulative energy counter: 係数 (0xD3) x 積算電力量単位 (0xE1), wrapping at 積算電力量有効桁数 (0xD7)
+ */
+struct SmartMeterEnergyScale {
+    uint32_t coefficient = 1;
+    int8_t pow = 0;
+    uint8_t digits = 8;
+
+    /**
+     * Counter value at which the meter wraps around to 0
+     *
+     * @return 10^digits
+     */
+    uint32_t modulo() const {
+        uint32_t modulo = 1;
+        for (int i = 0; i < digits; i++) {
+            modulo *= 10;
+        }
+        return modulo;
+    }
+
+    /**
+     * Convert counter to kWh
+     *
+     * @param counts cumulative counter or difference of counters
+     * @return kWh
+     */
+    double toKwh(uint32_t counts) const {
+        static const double POW10[] = {0.0001, 0.001, 0.01, 0.1, 1, 10, 100, 1000, 10000};
+        return (double) counts * coefficient * POW10[pow + 4];
+    }
+
+    /**
+     * Convert value of the property to its unit (SmartMeterProperty::getUnit()) following its scaling
+     *
+     * @tparam Prop property
+     * @param value raw value or difference of values
+     * @return scaled value
+     */
+    template<typename Prop>
+    double apply(typename Prop::type value) const {
+        return Prop::scale == SMART_METER_SCALE_CUMULATIVE_UNIT ? toKwh((uint32_t) value) : (double) value;
+    }
+};
+
+/**
+ * Emit JSON field of the property
+ *
+ * @param obj JSON object
+ * @param value value
+ */
+template<typename Prop, typename V>
+void smartMeterToJson(JsonObject obj, const V &value) {
+    obj[Prop::getKey()] = value;
+}
+
+#endif // !defined(LIB_ECHONET_SMART_METER_PROPERTY_H)
@@ -0,0 +1,103 @@
+#include <cstring>
+
+#include "lib/hex.h"
+
+/*
+ * The loops below work on one 32-bit word (the register width of ESP32) per step:
+ * 2 bytes <-> 4 hex digits, with the per-byte arithmetic done in the 4 lanes of the word at once.
+ * Words are loaded and stored with memcpy, so the first character is in the lowest lane.
+ */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "hex.cpp assumes a little-endian CPU"
+#endif
+
+/// 1 in every lane
+static const uint32_t ONES = 0x01010101;
+
+/// Most significant bit of every lane
+static const uint32_t HIGHS = 0x80808080;
+
+/**
+ * Mark lanes not less than a value
+ *
+ * @param word lanes of 0x00 - 0x7f
+ * @param value lower bound (0x01 - 0x80)
+ * @return HIGHS of lanes >= value
+ */
+static inline uint32_t lanesAtLeast(uint32_t word, uint8_t value) {
+    // adding 0x80 - value never carries into the next lane because each lane is below 0x80
+    return (word + ONES * (uint8_t) (0x80 - value)) & HIGHS;
+}
+
+/**
+ * Encode bytes to hex digits
+ *
+ * @param data data
+ * @param dataLen data length
+ * @param hex output (dataLen * 2 characters, not NUL-terminated)
+ * @param upperCase use upper case digits
+ * @return number of characters written
+ */
+size_t hexEncode(const uint8_t *data, size_t dataLen, char *hex, bool upperCase) {
+    // distance from '9' + 1 to 'A' or 'a'
+    const uint32_t letterOffset = upperCase ? 'A' - '0' - 10 : 'a' - '0' - 10;
+    size_t i = 0;
+    for (; i < dataLen; i += 2) {
+        uint32_t bytes = data[i];
+        size_t n = 2;
+        if (i + 1 < dataLen) {
+            bytes |= (uint32_t) data[i + 1] << 16;
+        } else {
+            n = 1;
+        }
+        // lanes: high nibble, low nibble of data[i], high nibble, low nibble of data[i + 1]
+        uint32_t nibbles = ((bytes >> 4) & 0x000f000f) | ((bytes & 0x000f000f) << 8);
+        // 1 in lanes of 10 - 15
+        uint32_t letters = lanesAtLeast(nibbles, 10) >> 7;
+        uint32_t digits = nibbles + ONES * '0' + letters * letterOffset;
+        memcpy(hex + i * 2, &digits, n * 2);
+    }
+    return dataLen * 2;
+}
+
+/**
+ * Decode hex digits to bytes
+ *
+ * @param hex hex digits (upper or lower case)
+ * @param hexLen number of digits (must be even)
+ * @param data output
+ * @param dataSize output size
+ * @return number of bytes (-1:odd length, invalid digit or too long)
+ */
+int hexDecode(const char *hex, size_t hexLen, uint8_t *data, size_t dataSize) {
+    if (hexLen % 2 != 0 || hexLen / 2 > dataSize) {
+        return -1;
+    }
+    size_t n = hexLen / 2;
+    for (size_t i = 0; i < n; i += 2) {
+        uint32_t chars = 0;
+        size_t count = i + 1 < n ? 4 : 2;
+        memcpy(&chars, hex + i * 2, count);
+        if (count == 2) {
+            // pad the missing byte with "00"
+            chars |= (ONES * '0') & 0xffff0000;
+        }
+        if (chars & HIGHS) {
+            return -1;
+        }
+        uint32_t digits = lanesAtLeast(chars, '0') & ~lanesAtLeast(chars, '9' + 1);
+        uint32_t lower = chars | ONES * 0x20;
+        uint32_t letters = lanesAtLeast(lower, 'a') & ~lanesAtLeast(lower, 'f' + 1);
+        if ((digits | letters) != HIGHS) {
+            return -1;
+        }
+        uint32_t nibbles = (chars & ONES * 0x0f) + (letters >> 7) * 9;
+        // (lane 0 << 4 | lane 1) and (lane 2 << 4 | lane 3)
+        uint32_t bytes = ((nibbles & 0x000f000f) << 4) | ((nibbles >> 8) & 0x000f000f);
+        data[i] = (uint8_t) bytes;
+        if (count == 4) {
+            data[i + 1] = (uint8_t) (bytes >> 16);
+        }
+    }
+    return (int) n;
+}
@@ -0,0 +1,11 @@
+#if !defined(LIB_HEX_H)
+#define LIB_HEX_H
+
+#include <cstddef>
+#include <cstdint>
+
+size_t hexEncode(const uint8_t *data, size_t dataLen, char *hex, bool upperCase = false);
+
+int hexDecode(const char *hex, size_t hexLen, uint8_t *data, size_t dataSize);
+
+#endif // !defined(LIB_HEX_H)
@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include <Preferences.h>
+
+#include "lib/nvs.h"
+
+/// NVS namespace
+static const char *NVS_NAMESPACE = "smartmeter";
+
+/**
+ * Save bytes to NVS
+ *
+ * @param key key (up to 15 characters)
+ * @param value value
+ * @param len value length
+ * @return true: success, false: failure
+ */
+bool nvsSaveBytes(const char *key, const void *value, size_t len) {
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("ERROR: Failed to begin NVS");
+        return false;
+    }
+    bool result = preferences.putBytes(key, value, len) == len;
+    if (!result) {
+        Serial.printf("ERROR: Failed to write NVS (key=%s)\n", key);
+    } else {
+        Serial.printf("NVS/Saved: %s (%d bytes)\n", key, len);
+    }
+    preferences.end();
+    return result;
+}
+
+/**
+ * Load bytes from NVS
+ *
+ * @param key key (up to 15 characters)
+ * @param value buffer
+ * @param len value length (stored value of another length is ignored)
+ * @return true: success, false: not found
+ */
+bool nvsLoadBytes(const char *key, void *value, size_t len) {
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, true)) {
+        Serial.println("ERROR: Failed to begin NVS");
+        return false;
+    }
+    bool result = preferences.getBytesLength(key) == len && preferences.getBytes(key, value, len) == len;
+    if (result) {
+        Serial.printf("NVS/Loaded: %s (%d bytes)\n", key, len);
+    }
+    preferences.end();
+    return result;
+}
+
+/**
+ * Remove value from NVS
+ *
+ * @param key key (up to 15 characters)
+ * @return true: removed, false: not found or failure
+ */
+bool nvsRemove(const char *key) {
+    Preferences preferences;
+    if (!preferences.begin(NVS_NAMESPACE, false)) {
+        Serial.println("ERROR: Failed to begin NVS");
+        return false;
+    }
+    bool result = preferences.remove(key);
+    if (result) {
+        Serial.printf("NVS/Removed: %s\n", key);
+    }
+    preferences.end();
+    return result;
+}
@@ -0,0 +1,12 @@
+#if !defined(LIB_NVS_H)
+#define LIB_NVS_H
+
+#include <Arduino.h>
+
+bool nvsSaveBytes(const char *key, const void *value, size_t len);
+
+bool nvsLoadBytes(const char *key, void *value, size_t len);
+
+bool nvsRemove(const char *key);
+
+#endif // !defined(LIB_NVS_H)
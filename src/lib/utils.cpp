@@ -1,9 +1,10 @@
-#include <iomanip>
 #include <sstream>
 #include <vector>
 #include <Arduino.h>
 #include <ArduinoJson.h>
 
+#include "lib/hex.h"
+
 String jsonEncode(const DynamicJsonDocument &jsonDoc) {
     String jsonStr;
     serializeJson(jsonDoc, jsonStr);
@@ -59,10 +60,7 @@ std::vector<std::string> splitSentence(const std::string &str) {
 }
 
 std::string hexString(const uint8_t *data, size_t dataSize) {
-    std::stringstream ss;
-    ss << std::hex << std::setfill('0');
-    for (auto i = 0; i < dataSize; ++i) {
-        ss << std::setw(2) << static_cast<int>(*(data + i));
-    }
-    return ss.str();
+    std::string str(dataSize * 2, '\0');
+    hexEncode(data, dataSize, &str[0]);
+    return str;
 }
@@ -1,149 +1,441 @@
-#include <iomanip>
-#include <map>
-#include <sstream>
-#include <M5Unified.h>
+#include <Arduino.h>
 
 #include "lib/wisun/BP35A.h"
+#include "lib/hex.h"
+#include "lib/nvs.h"
 #include "lib/utils.h"
 
+/// NVS key of cached session
+static const char *SESSION_KEY = "bp35a.session";
+
 /**
- * Connect to smart meter
- *
- * @return true:success, false:failure
+ * Session cached in NVS
  */
-bool BP35A::connect(const String &brouteId, const String &broutePassword) {
-    delay(2000);
-    _discardBuffer();
+typedef struct {
+    char addr[17];
+    char panId[5];
+    char channel[3];
+    char ipv6Addr[40];
+} __attribute__((packed)) bp35a_session_t;
 
-    M5.Display.setTextSize(2);
-    M5.Display.fillScreen(BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.printf("Initializing");
+/**
+ * Check if BP35A answers on the UART
+ *
+ * @return true:BP35A is connected
+ */
+bool BP35A::probe() {
+    _flushInput();
+    _sendCommand("SKVER");
+    bool result = _waitResponse("EVER ", 1000);
+    _flushInput();
+    return result;
+}
 
-    // Disable echo back
-    M5.Display.printf(".");
-    _sendCommand("SKSREG SFE 0");
-    if (!_waitResponse("OK", 5000)) {
-        return false;
-    }
+/**
+ * Start join sequence
+ *
+ * @param brouteId B-route ID
+ * @param broutePassword B-route password
+ * @param mode join mode
+ */
+void BP35A::startConnect(const String &brouteId, const String &broutePassword, ConnectMode mode) {
+    _brouteId = brouteId;
+    _broutePassword = broutePassword;
+    _meter = nullptr;
+    _connectMode = mode;
+    _joinUsingCache = false;
+    _setSessionState(SESSION_NONE);
+    _setJoinPhase(JOIN_PHASE_INITIALIZING);
+    _enterJoinState(mode == CONNECT_MODE_BOOT ? JOIN_RESET : JOIN_FLUSH);
+}
 
-    // Check information
-    M5.Display.printf(".");
-    _sendCommand("SKINFO");
-    if (!_waitResponse("OK", 5000)) {
-        return false;
-    }
-    _sendCommand("SKVER");
-    if (!_waitResponse("OK", 5000)) {
-        return false;
+/**
+ * Advance join sequence
+ *
+ * Consumes the lines received so far and the expired timer, and returns without blocking.
+ *
+ * @return status of join sequence
+ */
+WiSUN::ConnectStatus BP35A::pollConnect() {
+    LineView line;
+    while (_joinState != JOIN_DONE && _joinState != JOIN_FAILED && _pollLine(line)) {
+        if (line.startsWith("ERXUDP ")) {
+            // keep for receiveData()
+            auto data = _parseReceivedData(line);
+            if (data != nullptr) {
+                _received.push_back(std::move(data));
+            }
+        } else {
+            _onJoinLine(line);
+        }
     }
-    _sendCommand("SKAPPVER");
-    if (!_waitResponse("OK", 5000)) {
-        return false;
+    if (_joinState != JOIN_DONE && _joinState != JOIN_FAILED
+        && (long) (millis() - _joinDeadline) >= 0) {
+        _onJoinTimeout();
     }
 
-    // Configure option
-    _sendCommand("ROPT");
-    auto roptResult = _readLine(5000);
-    if (roptResult == nullptr || !roptResult->startsWith("OK ")) {
-        return false;
-    }
-    if (roptResult->substring(3) == "00") {
-        _sendCommand("WOPT 01"); // 何度も実行すると寿命が縮まるので注意!
-        if (!_waitResponse("OK", 5000)) {
-            return false;
-        }
+    switch (_joinState) {
+        case JOIN_DONE:
+            return CONNECT_SUCCEEDED;
+        case JOIN_IDLE:
+        case JOIN_FAILED:
+            return CONNECT_FAILED;
+        default:
+            return CONNECT_IN_PROGRESS;
     }
+}
 
-    // Set B-route ID/password
-    M5.Display.printf(".");
-    _sendCommand("SKSETPWD C " + broutePassword);
-    if (!_waitResponse("OK", 5000)) {
-        return false;
-    }
-    _sendCommand("SKSETRBID " + brouteId);
-    if (!_waitResponse("OK", 5000)) {
-        return false;
+/**
+ * Enter state of join sequence (send the command of the state)
+ *
+ * @param state next state
+ */
+void BP35A::_enterJoinState(JoinState state) {
+    if (state == JOIN_FAILED && _joinUsingCache && _connectMode == CONNECT_MODE_BOOT) {
+        // Cached session is stale: find the meter again
+        Serial.println("Failed to join with cached session. Scanning...");
+        _joinUsingCache = false;
+        _meter = nullptr;
+        _setJoinPhase(JOIN_PHASE_SCANNING);
+        state = JOIN_SCAN;
     }
+    _joinState = state;
+    _joinDeadline = millis() + 5000;
+    switch (state) {
+        case JOIN_RESET:
+            _sendCommand("SKRESET");
+            _joinDeadline = millis() + 500;
+            break;
+        case JOIN_BOOT:
+            _joinDeadline = millis() + 2500;
+            break;
+        case JOIN_FLUSH:
+            _flushInput();
+            _serial.print("\r\n");
+            _joinDeadline = millis() + 1000;
+            break;
+        case JOIN_DISABLE_ECHO:
+            _flushInput();
+            _onJoinStep();
+            _sendCommand("SKSREG SFE 0");
+            break;
+        case JOIN_INFO:
+            // Check information
+            _onJoinStep();
+            _sendCommand("SKINFO");
+            break;
+        case JOIN_VERSION:
+            _sendCommand("SKVER");
+            break;
+        case JOIN_APP_VERSION:
+            _sendCommand("SKAPPVER");
+            break;
+        case JOIN_READ_LIFETIME:
+            _sendCommand("SKSREG S16");
+            break;
+        case JOIN_READ_OPTION:
+            // Configure option
+            _sendCommand("ROPT");
+            break;
+        case JOIN_WRITE_OPTION:
+            _sendCommand("WOPT 01"); // 何度も実行すると寿命が縮まるので注意!
+            break;
+        case JOIN_SET_PASSWORD:
+            // Set B-route ID/password
+            _onJoinStep();
+            _sendCommand("SKSETPWD C " + _broutePassword);
+            break;
+        case JOIN_SET_ID:
+            _sendCommand("SKSETRBID " + _brouteId);
+            _scanDuration = 3;
+            break;
+        case JOIN_SCAN:
+            _onJoinStep();
+            _scanChannel[0] = _scanPanId[0] = _scanAddr[0] = '\0';
+            _scanLqi = -1;
+            _sendCommand("SKSCAN 3 FFFFFFFF " + (String) _scanDuration);
+            break;
+        case JOIN_SCAN_RESULT:
+            _joinDeadline = millis() + (1 << _scanDuration) * 1000;
+            break;
+        case JOIN_SCAN_INTERVAL:
+            _joinDeadline = millis() + 1000;
+            break;
+        case JOIN_LL64:
+            _showMeter();
 
-    M5.Display.println("OK");
-    M5.Display.printf("Scanning");
+            // Convert MAC to IPv6 address
+            _onJoinStep();
+            _sendCommand("SKLL64 " + _meter->addr);
+            break;
+        case JOIN_SET_CHANNEL:
+            // Register channel
+            _onJoinStep();
+            _sendCommand("SKSREG S2 " + _meter->channel);
+            break;
+        case JOIN_SET_PAN_ID:
+            // Register Pan ID
+            _onJoinStep();
+            _sendCommand("SKSREG S3 " + _meter->panId);
+            break;
+        case JOIN_REQUEST:
+            _onJoinStep();
+            _sendCommand("SKJOIN " + _meter->ipv6Addr);
+            break;
+        case JOIN_RESULT:
+            _joinDeadline = millis() + 30000;
+            break;
+        case JOIN_DONE:
+            _setJoinPhase(JOIN_PHASE_SUCCEEDED);
+            _setSessionState(SESSION_ESTABLISHED);
+            _saveSession();
+            break;
+        case JOIN_FAILED:
+            _setJoinPhase(JOIN_PHASE_FAILED);
+            break;
+        default:
+            break;
+    }
+}
 
-    // Scan
-    for (int dur = 3; dur <= 6; dur++) {
-        M5.Display.printf(".");
-        _sendCommand("SKSCAN 3 FFFFFFFF " + (String) dur);
-        if (!_waitResponse("OK", 5000)) {
-            return false;
-        }
-        _meter = _getScanResult((1 << dur) * 1000);
-        if (_meter != nullptr) {
+/**
+ * Handle line received during join sequence
+ *
+ * @param line received line
+ */
+void BP35A::_onJoinLine(const LineView &line) {
+    switch (_joinState) {
+        case JOIN_READ_LIFETIME:
+            if (line.startsWith("ESREG ")) {
+                auto lifetime = line.substring(6).toHex();
+                if (lifetime > 0) {
+                    _sessionLifetime = lifetime * 1000;
+                }
+            } else if (line.startsWith("FAIL ER")) {
+                _enterJoinState(JOIN_FAILED);
+            } else if (line.startsWith("OK")) {
+                _enterJoinState((JoinState) (_joinState + 1));
+            }
+            break;
+        case JOIN_READ_OPTION:
+            if (!line.startsWith("OK ")) {
+                _enterJoinState(JOIN_FAILED);
+            } else {
+                _enterJoinState(line.substring(3).equals("00") ? JOIN_WRITE_OPTION : JOIN_SET_PASSWORD);
+            }
+            break;
+        case JOIN_SET_ID:
+            if (line.startsWith("FAIL ER")) {
+                _enterJoinState(JOIN_FAILED);
+            } else if (line.startsWith("OK")) {
+                _meter = _connectMode != CONNECT_MODE_RESCAN ? _loadSession() : nullptr;
+                _joinUsingCache = _meter != nullptr;
+                if (_joinUsingCache) {
+                    // skip scan
+                    _showMeter();
+                    _enterJoinState(JOIN_SET_CHANNEL);
+                } else if (_connectMode == CONNECT_MODE_REJOIN) {
+                    _enterJoinState(JOIN_FAILED);
+                } else {
+                    _setJoinPhase(JOIN_PHASE_SCANNING);
+                    _enterJoinState(JOIN_SCAN);
+                }
+            }
+            break;
+        case JOIN_SCAN_RESULT: {
+            LineView key, value;
+            if (line.startsWith("EVENT 22 ")) {
+                if (_scanAddr[0] == '\0' || _scanPanId[0] == '\0' || _scanChannel[0] == '\0') {
+                    _onScanMissed();
+                } else {
+                    _meter = std::make_unique<BP35AMeterEntry>(_scanAddr, _scanPanId, _scanChannel);
+                    if (_scanLqi >= 0) {
+                        _linkQuality.onScan(LinkQuality::lqiToRssi(_scanLqi));
+                    }
+                    _enterJoinState(JOIN_LL64);
+                }
+            } else if (parseLineField(line, key, value)) {
+                // EPANDESC
+                if (key.equals("Channel")) {
+                    value.copyTo(_scanChannel, sizeof(_scanChannel));
+                } else if (key.equals("Pan ID")) {
+                    value.copyTo(_scanPanId, sizeof(_scanPanId));
+                } else if (key.equals("Addr")) {
+                    value.copyTo(_scanAddr, sizeof(_scanAddr));
+                } else if (key.equals("LQI")) {
+                    _scanLqi = (int) value.toHex();
+                }
+            }
             break;
         }
-        if (dur == 6) {
-            return false;
+        case JOIN_LL64: {
+            char ipv6Addr[40];
+            line.copyTo(ipv6Addr, sizeof(ipv6Addr));
+            _meter->ipv6Addr = ipv6Addr;
+            _enterJoinState(JOIN_SET_CHANNEL);
+            break;
         }
-        delay(1000);
+        case JOIN_RESULT:
+            if (line.startsWith("EVENT 24 ")) {
+                _enterJoinState(JOIN_FAILED);
+            } else if (line.startsWith("EVENT 25 ")) {
+                _enterJoinState(JOIN_DONE);
+            }
+            break;
+        case JOIN_DISABLE_ECHO:
+        case JOIN_INFO:
+        case JOIN_VERSION:
+        case JOIN_APP_VERSION:
+        case JOIN_WRITE_OPTION:
+        case JOIN_SET_PASSWORD:
+        case JOIN_SCAN:
+        case JOIN_SET_CHANNEL:
+        case JOIN_SET_PAN_ID:
+        case JOIN_REQUEST:
+            // command response: proceed to the next state
+            if (line.startsWith("FAIL ER")) {
+                _enterJoinState(JOIN_FAILED);
+            } else if (line.startsWith("OK")) {
+                _enterJoinState((JoinState) (_joinState + 1));
+            }
+            break;
+        default:
+            break;
     }
+}
 
-    M5.Display.fillScreen(BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.println("Addr: " + _meter->addr + ", Channel: " + _meter->channel + ", Pan ID: " + _meter->panId);
-    Serial.println("Addr: " + _meter->addr + ", Channel: " + _meter->channel + ", Pan ID: " + _meter->panId);
-
-    M5.Display.printf("Connecting");
-
-    // Convert MAC to IPv6 address
-    M5.Display.printf(".");
-    _sendCommand("SKLL64 " + _meter->addr);
-    auto ipv6Addr = _readLine(5000);
-    if (ipv6Addr == nullptr) {
-        return false;
+/**
+ * Handle timer of join sequence
+ */
+void BP35A::_onJoinTimeout() {
+    switch (_joinState) {
+        case JOIN_RESET:
+        case JOIN_BOOT:
+        case JOIN_FLUSH:
+            _enterJoinState((JoinState) (_joinState + 1));
+            break;
+        case JOIN_SCAN_RESULT:
+            _flushInput();
+            _onScanMissed();
+            break;
+        case JOIN_SCAN_INTERVAL:
+            _enterJoinState(JOIN_SCAN);
+            break;
+        default:
+            _flushInput();
+            _enterJoinState(JOIN_FAILED);
+            break;
     }
-    _meter->ipv6Addr = *ipv6Addr;
+}
 
-    // Register channel
-    M5.Display.printf(".");
-    _sendCommand("SKSREG S2 " + _meter->channel);
-    if (!_waitResponse("OK", 5000)) {
-        return false;
+/**
+ * Scan again with longer duration, or give up
+ */
+void BP35A::_onScanMissed() {
+    if (_scanDuration >= 6) {
+        _enterJoinState(JOIN_FAILED);
+        return;
     }
+    _scanDuration++;
+    _enterJoinState(JOIN_SCAN_INTERVAL);
+}
 
-    // Register Pan ID
-    M5.Display.printf(".");
-    _sendCommand("SKSREG S3 " + _meter->panId);
-    if (!_waitResponse("OK", 5000)) {
-        return false;
-    }
+/**
+ * Send PANA re-authentication command
+ *
+ * The result is notified by EVENT 25 (success) or EVENT 24 (failure).
+ */
+void BP35A::_startReauthentication() {
+    _sendCommand("SKREJOIN");
+}
 
-    // Join
-    M5.Display.printf(".");
-    _sendCommand("SKJOIN " + _meter->ipv6Addr);
-    if (!_waitResponse("OK", 5000)) {
-        return false;
+/**
+ * Handle event notified while connected
+ *
+ * @param line EVENT line
+ */
+void BP35A::_onEvent(const LineView &line) {
+    LineTokenizer tokens(line);
+    LineView token;
+    if (!tokens.skip(1, token)) {
+        return;
     }
-    if (!_getJoinResult(30000)) {
-        M5.Display.println("failed");
-        return false;
+    auto event = token.toHex();
+    switch (event) {
+        case 0x24: // PANA connection failed
+            if (getSessionState() == SESSION_REAUTHENTICATING) {
+                _setSessionState(SESSION_LOST);
+            }
+            break;
+        case 0x25: // PANA connection succeeded
+            _setSessionState(SESSION_ESTABLISHED);
+            break;
+        case 0x26: // Session termination requested by the meter
+        case 0x27: // Session terminated
+        case 0x28: // Session termination timed out
+        case 0x29: // Session lifetime expired
+            if (getSessionState() == SESSION_ESTABLISHED) {
+                Serial.printf("PANA session ended (EVENT %02lX)\n", event);
+                reauthenticate();
+            }
+            break;
+        default:
+            break;
     }
+}
 
-    M5.Display.println("OK");
-    return true;
+/**
+ * Show the meter to join
+ */
+void BP35A::_showMeter() {
+    Serial.println("Addr: " + _meter->addr + ", Channel: " + _meter->channel + ", Pan ID: " + _meter->panId);
+    _setJoinPhase(JOIN_PHASE_CONNECTING);
 }
 
 /**
- * Discard buffer
+ * Load the session of the last successful join
+ *
+ * @return meter (nullptr:not cached)
  */
-void BP35A::_discardBuffer() {
-    delay(500);
-    while (_serial.available()) {
-        _serial.read();
+std::unique_ptr<BP35AMeterEntry> BP35A::_loadSession() {
+    bp35a_session_t session{};
+    if (!nvsLoadBytes(SESSION_KEY, &session, sizeof(session))) {
+        return nullptr;
     }
-    _serial.print("\r\n");
-    delay(1000);
-    while (_serial.available()) {
-        _serial.read();
+    session.addr[sizeof(session.addr) - 1] = '\0';
+    session.panId[sizeof(session.panId) - 1] = '\0';
+    session.channel[sizeof(session.channel) - 1] = '\0';
+    session.ipv6Addr[sizeof(session.ipv6Addr) - 1] = '\0';
+    auto meter = std::make_unique<BP35AMeterEntry>(session.addr, session.panId, session.channel);
+    meter->ipv6Addr = session.ipv6Addr;
+    if (meter->addr.isEmpty() || meter->panId.isEmpty() || meter->channel.isEmpty() || meter->ipv6Addr.isEmpty()) {
+        return nullptr;
     }
+    return meter;
+}
+
+/**
+ * Save the session of the successful join
+ */
+void BP35A::_saveSession() {
+    bp35a_session_t session{};
+    strncpy(session.addr, _meter->addr.c_str(), sizeof(session.addr) - 1);
+    strncpy(session.panId, _meter->panId.c_str(), sizeof(session.panId) - 1);
+    strncpy(session.channel, _meter->channel.c_str(), sizeof(session.channel) - 1);
+    strncpy(session.ipv6Addr, _meter->ipv6Addr.c_str(), sizeof(session.ipv6Addr) - 1);
+    bp35a_session_t saved{};
+    if (nvsLoadBytes(SESSION_KEY, &saved, sizeof(saved)) && memcmp(&saved, &session, sizeof(session)) == 0) {
+        return;
+    }
+    nvsSaveBytes(SESSION_KEY, &session, sizeof(session));
+}
+
+/**
+ * Discard received data
+ */
+void BP35A::_flushInput() {
+    _receiver.clear();
+    _framer.clear();
 }
 
 /**
@@ -152,8 +444,25 @@ void BP35A::_discardBuffer() {
  * @param data command string
  */
 void BP35A::_sendCommand(const String &data) {
+    size_t len = data.length();
+    if (len + 2 > sizeof(_txBuffer)) {
+        Serial.printf("ERROR: Command too long (%d bytes)\n", len);
+        return;
+    }
+    memcpy(_txBuffer, data.c_str(), len);
+    memcpy(_txBuffer + len, "\r\n", 2);
+    _transmit(len + 2);
     Serial.println("> " + data);
-    _serial.print(data + "\r\n");
+}
+
+/**
+ * Send the command in the TX buffer with a single write
+ *
+ * @param len command length
+ */
+void BP35A::_transmit(size_t len) {
+    _serial.write((const uint8_t *) _txBuffer, len);
+    _linkQuality.onUart(len);
 }
 
 /**
@@ -162,41 +471,61 @@ void BP35A::_sendCommand(const String &data) {
  * @return true:received, false:error or timeout
  */
 bool BP35A::_waitResponse(const char *expect, int timeout) {
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto line = _readLine(timeout - (int) (millis() - start));
-        if (line == nullptr || line->startsWith("FAIL ER")) {
+    auto deadline = millis() + timeout;
+    LineView line;
+    while (_readLine(line, deadline)) {
+        if (line.startsWith("FAIL ER")) {
             return false;
-        } else if (line->startsWith(expect)) {
+        } else if (line.startsWith(expect)) {
             return true;
+        } else if (line.startsWith("EVENT ")) {
+            _onEvent(line);
+        } else if (line.startsWith("ERXUDP ")) {
+            // keep for receiveData()
+            auto data = _parseReceivedData(line);
+            if (data != nullptr) {
+                _received.push_back(std::move(data));
+            }
         }
     }
     return false;
 }
 
 /**
- * Read response
+ * Read a line if completely received
  *
- * @param timeout timeout (milliseconds)
- * @return response string (nullptr:timeout)
+ * Bytes received so far are accumulated without blocking.
+ *
+ * @param line received line (without CRLF)
+ * @return true:received, false:not yet
  */
-std::unique_ptr<String> BP35A::_readLine(int timeout) {
-    std::stringstream ss;
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto s = _serial.readStringUntil('\n');
-        if (s.isEmpty()) {
+bool BP35A::_pollLine(LineView &line) {
+    int c;
+    while ((c = _receiver.read()) >= 0) {
+        if (!_framer.push((char) c, line)) {
             continue;
         }
-        ss << s.c_str();
-        auto line = ss.str();
-        if (line.at(line.length() - 1) == '\r') {
-            line.pop_back();
-            Serial.printf("< %s\n", line.c_str());
-            return std::make_unique<String>(line.c_str());
-        }
+        _linkQuality.onUart(line.length() + 2);
+        Serial.printf("< %s\n", line.data());
+        return true;
     }
-    return nullptr;
+    return false;
+}
+
+/**
+ * Read response
+ *
+ * @param line received line (without CRLF, valid until the next line is read)
+ * @param deadline deadline (millis())
+ * @return true:received, false:timeout
+ */
+bool BP35A::_readLine(LineView &line, unsigned long deadline) {
+    do {
+        if (_pollLine(line)) {
+            return true;
+        }
+    } while (_receiver.wait(deadline));
+    return false;
 }
 
 /**
@@ -207,14 +536,22 @@ std::unique_ptr<String> BP35A::_readLine(int timeout) {
  * @param timeout timeout (milliseconds)
  */
 bool BP35A::sendData(const uint8_t *data, size_t dataLen, int timeout) {
-    Serial.printf("> SKSENDTO 1 %s 0E1A 1 %04X ", _meter->ipv6Addr.c_str(), dataLen);
-    _serial.printf("SKSENDTO 1 %s 0E1A 1 %04X ", _meter->ipv6Addr.c_str(), dataLen);
-    for (int i = 0; i < dataLen; i++) {
-        Serial.printf("%02X", *(data + i));
-        _serial.write(*(data + i));
+    if (_meter == nullptr) {
+        // not joined (scanning or failed to join)
+        return false;
     }
-    Serial.println();
-    _serial.print("\r\n");
+    auto headerLen = (size_t) snprintf(_txBuffer, sizeof(_txBuffer), "SKSENDTO 1 %s 0E1A 1 %04X ",
+                                       _meter->ipv6Addr.c_str(), (unsigned) dataLen);
+    if (dataLen > MAX_TX_DATA_LENGTH || headerLen + dataLen + 2 > sizeof(_txBuffer)) {
+        Serial.printf("ERROR: Data too long (%d bytes)\n", dataLen);
+        return false;
+    }
+    memcpy(_txBuffer + headerLen, data, dataLen);
+    memcpy(_txBuffer + headerLen + dataLen, "\r\n", 2);
+    _transmit(headerLen + dataLen + 2);
+
+    // log after the command is handed to the UART
+    Serial.printf("> %.*s%s\n", (int) headerLen, _txBuffer, hexString(data, dataLen).c_str());
     return _waitResponse("OK", timeout);
 }
 
@@ -225,76 +562,47 @@ bool BP35A::sendData(const uint8_t *data, size_t dataLen, int timeout) {
  * @return ECHONET Lite data (nullptr:failure)
  */
 std::unique_ptr<std::vector<uint8_t>> BP35A::receiveData(int timeout) {
-    auto result = std::make_unique<std::vector<uint8_t>>();
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto line = _readLine(timeout - (int) (millis() - start));
-        if (line == nullptr) {
-            continue;
-        } else if (line->startsWith("ERXUDP ")) {
-            auto tokens = splitString(line->c_str(), " ");
-            auto data = tokens[8];
-            for (int i = 0; i < data.length(); i += 2) {
-                auto parsed = (uint8_t) strtoul(data.substr(i, 2).c_str(), nullptr, 16);
-                result->push_back(parsed);
-            }
-            return result;
-        }
+    if (!_received.empty()) {
+        auto result = std::move(_received.front());
+        _received.pop_front();
+        return result;
     }
-    return nullptr;
-}
-
-/**
- * Receive scan result
- *
- * @param timeout timeout (ms)
- * @return Scan result (nullptr:no entry or timeout)
- */
-std::unique_ptr<BP35AMeterEntry> BP35A::_getScanResult(int timeout) {
-    String channel;
-    String panId;
-    String addr;
-
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto line = _readLine(timeout - (int) (millis() - start));
-        if (line == nullptr) {
-            continue;
-        } else if (line->indexOf("Channel:") >= 0) {
-            channel = line->substring(line->indexOf("Channel:") + 8);
-        } else if (line->indexOf("Pan ID:") >= 0) {
-            panId = line->substring(line->indexOf("Pan ID:") + 7);
-        } else if (line->indexOf("Addr:") >= 0) {
-            addr = line->substring(line->indexOf("Addr:") + 5);
-        } else if (line->startsWith("EVENT 22 ")) {
-            if (addr.isEmpty() || panId.isEmpty() || channel.isEmpty()) {
-                return nullptr;
-            }
-            return std::make_unique<BP35AMeterEntry>(addr, panId, channel);
+    auto deadline = millis() + timeout;
+    LineView line;
+    while (_readLine(line, deadline)) {
+        if (line.startsWith("EVENT ")) {
+            _onEvent(line);
+        } else if (line.startsWith("ERXUDP ")) {
+            return _parseReceivedData(line);
         }
     }
-    _discardBuffer();
     return nullptr;
 }
 
 /**
- * Wait join result
+ * Parse ERXUDP
  *
- * @return true:success, false:failure or timeout
+ * @param line ERXUDP line
+ * @return ECHONET Lite data (nullptr:failure)
  */
-bool BP35A::_getJoinResult(int timeout) {
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto line = _readLine(timeout - (int) (millis() - start));
-        if (line == nullptr) {
-            continue;
-        }
-        if (line->indexOf("EVENT 24") >= 0) {
-            return false;
-        } else if (line->indexOf("EVENT 25") >= 0) {
-            return true;
-        }
+std::unique_ptr<std::vector<uint8_t>> BP35A::_parseReceivedData(const LineView &line) {
+    // ERXUDP <SENDER> <DEST> <RPORT> <LPORT> <SENDERLLA> <SECURED> <DATALEN> <DATA>
+    LineTokenizer tokens(line);
+    LineView dataLen, data;
+    if (!tokens.skip(7, dataLen) || !tokens.next(data)) {
+        return nullptr;
     }
-    _discardBuffer();
-    return false;
+    size_t len = dataLen.toHex();
+    if (data.length() != len * 2) {
+        Serial.printf("ERROR: ERXUDP length mismatch (%u != %u)\n", data.length() / 2, len);
+        return nullptr;
+    }
+    // ERXUDP of BP35A carries no RSSI / LQI
+    _linkQuality.onFrame();
+    auto result = std::make_unique<std::vector<uint8_t>>(len);
+    if (hexDecode(data.data(), data.length(), result->data(), result->size()) < 0) {
+        Serial.println("ERROR: Invalid ERXUDP data");
+        return nullptr;
+    }
+    return result;
 }
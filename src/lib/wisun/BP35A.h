@@ -1,6 +1,10 @@
 #if !defined(LIB_WISUN_BP35A_H)
 #define LIB_WISUN_BP35A_H
 
+#include <deque>
+
+#include "lib/wisun/LineFramer.h"
+#include "lib/wisun/UartReceiver.h"
 #include "lib/wisun/WiSUN.h"
 
 /**
@@ -21,36 +25,150 @@ public:
  */
 class BP35A : public WiSUN {
 public:
-    explicit BP35A(const HardwareSerial &serial, int8_t rxPin, int8_t txPin)
+    explicit BP35A(HardwareSerial &serial, int8_t rxPin, int8_t txPin)
             : _serial(serial), _rxPin(rxPin), _txPin(txPin) {
+        // default of register S16, until it is read in the join sequence
+        _sessionLifetime = 7200UL * 1000;
+        // queue a whole command so that write() returns without waiting for the FIFO
+        _serial.setTxBufferSize(sizeof(_txBuffer));
+        _serial.setRxBufferSize(UartReceiver::RX_BUFFER_SIZE);
         _serial.begin(115200, SERIAL_8N1, _rxPin, _txPin);
+        _receiver.begin();
+        _linkQuality.setBaudRate(115200);
     };
 
-    bool connect(const String &brouteId, const String &broutePassword) override;
+    bool probe();
+
+    void startConnect(const String &brouteId, const String &broutePassword, ConnectMode mode) override;
+
+    ConnectStatus pollConnect() override;
 
     bool sendData(const uint8_t *data, size_t dataLen, int timeout) override;
 
     std::unique_ptr <std::vector<uint8_t>> receiveData(int timeout) override;
 
+    String getMeterAddress() const override { return _meter != nullptr ? _meter->addr : String(); }
+
 private:
-    HardwareSerial _serial;
+    /**
+     * Join sequence
+     *
+     * Each state sends its command on entry and waits for the response line or its timer.
+     */
+    typedef enum {
+        JOIN_IDLE = 0,
+        /// Reset the module
+        JOIN_RESET,
+        /// Wait for the module to boot
+        JOIN_BOOT,
+        /// Discard garbage after an empty line
+        JOIN_FLUSH,
+        JOIN_DISABLE_ECHO,
+        JOIN_INFO,
+        JOIN_VERSION,
+        JOIN_APP_VERSION,
+        /// Read PANA session lifetime (S16)
+        JOIN_READ_LIFETIME,
+        JOIN_READ_OPTION,
+        JOIN_WRITE_OPTION,
+        JOIN_SET_PASSWORD,
+        JOIN_SET_ID,
+        JOIN_SCAN,
+        JOIN_SCAN_RESULT,
+        /// Wait before scanning with longer duration
+        JOIN_SCAN_INTERVAL,
+        JOIN_LL64,
+        JOIN_SET_CHANNEL,
+        JOIN_SET_PAN_ID,
+        JOIN_REQUEST,
+        JOIN_RESULT,
+        JOIN_DONE,
+        JOIN_FAILED,
+    } JoinState;
+
+    /// UART (by reference: a copy would delete the lock of the original on destruction)
+    HardwareSerial &_serial;
     int8_t _rxPin;
     int8_t _txPin;
 
+    /// Received bytes from the module
+    UartReceiver _receiver{_serial};
+
     /// Meter
     std::unique_ptr <BP35AMeterEntry> _meter;
 
-    void _discardBuffer();
+    /// Data received while waiting for command response
+    std::deque<std::unique_ptr<std::vector<uint8_t>>> _received;
+
+    /// Maximum length of a line (ERXUDP of the E2+E4 history response is about 930 characters)
+    static const size_t MAX_LINE_LENGTH = 1024;
+
+    /// Lines received from the module
+    LineFramer<MAX_LINE_LENGTH> _framer;
+
+    /// Maximum length of ECHONET Lite data to send (SKSENDTO)
+    static const size_t MAX_TX_DATA_LENGTH = 1232;
+
+    /// Command being sent (SKSENDTO header up to 63 characters, data and CRLF)
+    char _txBuffer[64 + MAX_TX_DATA_LENGTH + 2] = {};
+
+    /// State of join sequence
+    JoinState _joinState = JOIN_IDLE;
+
+    /// Timer of the current state
+    unsigned long _joinDeadline = 0;
+
+    String _brouteId;
+    String _broutePassword;
+
+    /// Mode of join sequence
+    ConnectMode _connectMode = CONNECT_MODE_BOOT;
+
+    /// Joining with the session cached in NVS
+    bool _joinUsingCache = false;
+
+    /// Scan duration
+    int _scanDuration = 0;
+
+    /// Scan result being received (EPANDESC)
+    char _scanChannel[3] = {};
+    char _scanPanId[5] = {};
+    char _scanAddr[17] = {};
+
+    /// LQI of the meter found by scan (-1: unknown)
+    int _scanLqi = -1;
+
+    void _startReauthentication() override;
+
+    void _onEvent(const LineView &line);
+
+    void _enterJoinState(JoinState state);
+
+    void _onJoinLine(const LineView &line);
+
+    void _onJoinTimeout();
+
+    void _onScanMissed();
+
+    void _showMeter();
+
+    std::unique_ptr<BP35AMeterEntry> _loadSession();
+
+    void _saveSession();
+
+    void _flushInput();
 
     void _sendCommand(const String &data);
 
+    void _transmit(size_t len);
+
     bool _waitResponse(const char *expect, int timeout);
 
-    std::unique_ptr <String> _readLine(int timeout);
+    bool _pollLine(LineView &line);
 
-    std::unique_ptr <BP35AMeterEntry> _getScanResult(int timeout);
+    bool _readLine(LineView &line, unsigned long deadline);
 
-    bool _getJoinResult(int timeout);
+    std::unique_ptr<std::vector<uint8_t>> _parseReceivedData(const LineView &line);
 };
 
 #endif // !defined(LIB_WISUN_BP35A_H)
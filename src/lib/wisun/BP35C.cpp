@@ -1,9 +1,14 @@
 #include <iomanip>
-#include <M5Unified.h>
+#include <Arduino.h>
 
 #include "lib/wisun/BP35C.h"
+#include "lib/hex.h"
+#include "lib/nvs.h"
 #include "lib/utils.h"
 
+/// NVS key of cached session
+static const char *SESSION_KEY = "bp35c.session";
+
 /**
  * Command header
  */
@@ -37,6 +42,17 @@ typedef struct {
     uint8_t rssi;
 } __attribute__((packed)) bp35c_scan_result_t;
 
+/**
+ * Session cached in NVS
+ *
+ * The link-local IPv6 address is derived from the MAC address.
+ */
+typedef struct {
+    uint8_t macAddress[8];
+    uint8_t panId[2];
+    uint8_t channel;
+} __attribute__((packed)) bp35c_session_t;
+
 /**
  * Transmit data request header
  */
@@ -48,152 +64,477 @@ typedef struct {
 } __attribute__((packed)) bp35c_tx_request_header_t;
 
 /**
- * Connect to smart meter
+ * Baud rates of UART setting (0x00F8)
+ */
+static const struct {
+    uint32_t baudRate;
+    uint8_t code;
+} BAUD_RATES[] = {
+        {115200, 0x00},
+        {230400, 0x01},
+        {460800, 0x02},
+        {921600, 0x03},
+};
+
+/**
+ * Check if BP35C answers on the UART
  *
- * @return true:success, false:failure
+ * @return true:BP35C is connected
  */
-bool BP35C::connect(const String &brouteId, const String &broutePassword) {
-    // Reset hardware
-    pinMode(26, OUTPUT);
-    digitalWrite(26, LOW);
-    delay(100);
-    digitalWrite(26, HIGH);
-
-    delay(2000);
-    _discardBuffer();
-
-    M5.Display.setTextSize(2);
-    M5.Display.fillScreen(BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.printf("Initializing");
-
-    // Reset
-    M5.Display.printf(".");
-    _sendCommand(0x00d9); // Reset hardware
-    if (!_waitResponse(0x6019, nullptr, 0, 5000)) {
-        return false;
+bool BP35C::probe() {
+    _flushInput();
+    _sendCommand(0x006b); // Get version information
+    bool result = _waitResponse(0x206b, nullptr, 0, 1000);
+    _flushInput();
+    return result;
+}
+
+/**
+ * Start join sequence
+ *
+ * @param brouteId B-route ID
+ * @param broutePassword B-route password
+ * @param mode join mode
+ */
+void BP35C::startConnect(const String &brouteId, const String &broutePassword, ConnectMode mode) {
+    _brouteId = brouteId;
+    _broutePassword = broutePassword;
+    _meter = nullptr;
+    _connectMode = mode;
+    _joinUsingCache = mode != CONNECT_MODE_RESCAN;
+    _setSessionState(SESSION_NONE);
+    _setJoinPhase(JOIN_PHASE_INITIALIZING);
+    // hardware reset only on boot, otherwise reset by command
+    _enterJoinState(mode == CONNECT_MODE_BOOT ? JOIN_RESET_PIN : JOIN_RESET);
+}
+
+/**
+ * Advance join sequence
+ *
+ * Consumes the commands received so far and the expired timer, and returns without blocking.
+ *
+ * @return status of join sequence
+ */
+WiSUN::ConnectStatus BP35C::pollConnect() {
+    BP35CCommand command;
+    while (_joinState != JOIN_DONE && _joinState != JOIN_FAILED && _pollCommand(command)) {
+        if (command.getCommandCode() == 0x6018) { // Notify Data Reception
+            // keep for receiveData()
+            auto received = _parseReceivedData(command);
+            if (received != nullptr) {
+                _received.push_back(std::move(received));
+            }
+        } else {
+            _onJoinCommand(command);
+        }
+    }
+    if (_joinState != JOIN_DONE && _joinState != JOIN_FAILED && (long) (millis() - _joinDeadline) >= 0) {
+        _onJoinTimeout();
     }
 
-    // Check version
-    M5.Display.printf(".");
-    _sendCommand(0x006b); // Get version information
-    if (!_waitResponse(0x206b, nullptr, 0, 5000)) {
-        return false;
+    switch (_joinState) {
+        case JOIN_DONE:
+            return CONNECT_SUCCEEDED;
+        case JOIN_IDLE:
+        case JOIN_FAILED:
+            return CONNECT_FAILED;
+        default:
+            return CONNECT_IN_PROGRESS;
+    }
+}
+
+/**
+ * Enter state of join sequence (send the command of the state)
+ *
+ * @param state next state
+ */
+void BP35C::_enterJoinState(JoinState state) {
+    if (state == JOIN_FAILED && _joinUsingCache && _meter != nullptr && _connectMode == CONNECT_MODE_BOOT) {
+        // Cached session is stale: reset the module and find the meter again
+        Serial.println("Failed to join with cached session. Scanning...");
+        _joinUsingCache = false;
+        _meter = nullptr;
+        _setJoinPhase(JOIN_PHASE_INITIALIZING);
+        state = JOIN_RESET_PIN;
+    }
+    _joinState = state;
+    _joinDeadline = millis() + 5000;
+    _joinExpectCommand = 0;
+    _joinExpectResult = 0x01;
+    switch (state) {
+        case JOIN_RESET_PIN:
+            // Reset hardware (the module restarts at the default baud rate)
+            _updateBaudRate(DEFAULT_BAUD_RATE);
+            pinMode(26, OUTPUT);
+            digitalWrite(26, LOW);
+            _joinDeadline = millis() + 100;
+            break;
+        case JOIN_BOOT:
+            digitalWrite(26, HIGH);
+            _joinDeadline = millis() + 3000;
+            break;
+        case JOIN_RESET:
+            _flushInput();
+            _onJoinStep();
+            _sendCommand(0x00d9); // Reset hardware
+            _joinExpectCommand = 0x6019;
+            _joinExpectResult = -1;
+            break;
+        case JOIN_VERSION:
+            // Check version
+            _onJoinStep();
+            _sendCommand(0x006b); // Get version information
+            _joinExpectCommand = 0x206b;
+            _joinExpectResult = -1;
+            break;
+        case JOIN_UART_SETTINGS: {
+            const uint8_t *code = nullptr;
+            for (const auto &baudRate: BAUD_RATES) {
+                if (baudRate.baudRate == _targetBaudRate) {
+                    code = &baudRate.code;
+                }
+            }
+            if (_targetBaudRate == _baudRate || _baudRateFailed || code == nullptr) {
+                if (code == nullptr && !_baudRateFailed) {
+                    Serial.printf("WARN: Baud rate %u is not supported\n", _targetBaudRate);
+                    _baudRateFailed = true;
+                }
+                _enterJoinState(JOIN_INITIAL_SETTINGS);
+                return;
+            }
+            _sendCommand(0x00f8, code, 1); // UART setting
+            _joinExpectCommand = 0x20f8;
+            _joinExpectResult = -1;
+            break;
+        }
+        case JOIN_UART_VERIFY:
+            _updateBaudRate(_targetBaudRate);
+            _sendCommand(0x006b); // Get version information
+            _joinExpectCommand = 0x206b;
+            _joinExpectResult = -1;
+            _joinDeadline = millis() + 1000;
+            break;
+        case JOIN_INITIAL_SETTINGS:
+            // Setup
+            _onJoinStep();
+            _sendInitialSettings(0x04); // Channel: 922.5
+            _scanDuration = 6;
+            break;
+        case JOIN_SCAN: {
+            _onJoinStep();
+            bp35c_scan_request_t scanRequest = {
+                    .scanTime = _scanDuration, // 9.64ms×2^dur
+                    .scanChannel = {0x00, 0x03, 0xff, 0xf0}, // scan channel 4 to 17
+                    .idSetting = 0x01, // Paring ID set
+                    .pairingId = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
+            };
+            // set the last eight characters of Route-B authentication ID to Pairing ID.
+            memcpy(scanRequest.pairingId, _brouteId.c_str() + 24, sizeof(scanRequest.pairingId));
+            _scanned = nullptr;
+            _sendCommand(0x0051, (uint8_t *) &scanRequest, sizeof(scanRequest)); // Execute Active Scan
+            _joinDeadline = millis() + (1 << _scanDuration) * 1000;
+            break;
+        }
+        case JOIN_SCAN_INTERVAL:
+            _joinDeadline = millis() + 1000;
+            break;
+        case JOIN_CHANNEL_SETTINGS:
+            Serial.printf("Addr: %s, Channel: %d, Pan ID: %s\n",
+                          hexString(_meter->addr, sizeof(_meter->addr)).c_str(), _meter->channel,
+                          hexString(_meter->panId, sizeof(_meter->panId)).c_str());
+            _setJoinPhase(JOIN_PHASE_CONNECTING);
+
+            // Setup
+            _onJoinStep();
+            _sendInitialSettings(_meter->channel);
+            break;
+        case JOIN_SET_AUTH: {
+            // Set B-route ID/password
+            _onJoinStep();
+            struct {
+                uint8_t id[32];
+                uint8_t password[12];
+            } authData = {};
+            memcpy(authData.id, _brouteId.c_str(), sizeof(authData.id));
+            memcpy(&authData.password, _broutePassword.c_str(), sizeof(authData.password));
+            _sendCommand(0x0054, (uint8_t *) &authData, sizeof(authData)); // Set Route-B PANA Authentication Information
+            _joinExpectCommand = 0x2054;
+            break;
+        }
+        case JOIN_INITIATE:
+            // Initiate connection
+            _onJoinStep();
+            _sendCommand(0x0053, nullptr, 0); // Initiate Route-B Operation
+            _joinExpectCommand = 0x2053;
+            break;
+        case JOIN_OPEN_UDP: {
+            // Open UDP port
+            _onJoinStep();
+            uint8_t openUdpData[] = {0x0e, 0x1a}; // port: 3610
+            _sendCommand(0x0005, openUdpData, sizeof(openUdpData)); // Open UDP Port
+            _joinExpectCommand = 0x2005;
+            break;
+        }
+        case JOIN_PANA:
+            // Authenticate
+            _onJoinStep();
+            _sendCommand(0x0056, nullptr, 0); // Initiate Route-B PANA
+            _joinExpectCommand = 0x2056;
+            break;
+        case JOIN_PANA_RESULT:
+            _joinExpectCommand = 0x6028; // Notify PANA Authentication Result
+            break;
+        case JOIN_DONE:
+            _setJoinPhase(JOIN_PHASE_SUCCEEDED);
+            _setSessionState(SESSION_ESTABLISHED);
+            _saveSession();
+            break;
+        case JOIN_FAILED:
+            _setJoinPhase(JOIN_PHASE_FAILED);
+            break;
+        default:
+            break;
     }
+}
 
-    // Setup
-    M5.Display.printf(".");
+/**
+ * Send initial settings
+ *
+ * @param channel channel
+ */
+void BP35C::_sendInitialSettings(uint8_t channel) {
     uint8_t initialSettingsData[] = {
             0x05, // Operation mode: Dual (Route B and HAN)
             0x00, // HAN sleep function setting: Disable
-            0x04, // Channel: 922.5
+            channel, // Channel
             0x00, // Transmission power: 20mW
     };
-    uint8_t initialSettingsExpects = {0x01};
     _sendCommand(0x005f, initialSettingsData, sizeof(initialSettingsData)); // Initial settings
-    if (!_waitResponse(0x205f, &initialSettingsExpects, sizeof(initialSettingsExpects), 5000)) {
-        return false;
-    }
+    _joinExpectCommand = 0x205f;
+}
 
-    M5.Display.println("OK");
-    M5.Display.printf("Scanning");
-
-    // Scan
-    for (uint8_t dur = 6; dur <= 8; dur++) {
-        M5.Display.printf(".");
-        bp35c_scan_request_t scanRequest = {
-                .scanTime = dur, // 9.64ms×2^dur
-                .scanChannel = {0x00, 0x03, 0xff, 0xf0}, // scan channel 4 to 17
-                .idSetting = 0x01, // Paring ID set
-                .pairingId = {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
-        };
-        // set the last eight characters of Route-B authentication ID to Pairing ID.
-        memcpy(scanRequest.pairingId, brouteId.c_str() + 24, sizeof(scanRequest.pairingId));
-        _sendCommand(0x0051, (uint8_t *) &scanRequest, sizeof(scanRequest)); // Execute Active Scan
-        _meter = _getScanResult((1 << dur) * 1000);
-        if (_meter != nullptr) {
-            break;
-        }
-        if (dur == 8) {
-            return false;
+/**
+ * Handle command received during join sequence
+ *
+ * @param command received command
+ */
+void BP35C::_onJoinCommand(const BP35CCommand &command) {
+    auto data = command.getData();
+    size_t dataLen = command.getDataLen();
+    auto commandCode = command.getCommandCode();
+
+    if (_joinState == JOIN_SCAN) {
+        auto scanResult = (const bp35c_scan_result_t *) data;
+        if (commandCode == 0x4051 && dataLen >= sizeof(bp35c_scan_result_t) && scanResult->scanResult == 0x00) {
+            // Notification
+            uint8_t macAddress[8], panId[2];
+            memcpy(macAddress, scanResult->macAddress, sizeof(macAddress));
+            memcpy(panId, scanResult->panId, sizeof(panId));
+            _linkQuality.onScan((int8_t) scanResult->rssi);
+            _scanned = std::make_unique<BP35CMeterEntry>(macAddress, panId, scanResult->channel);
+        } else if (commandCode == 0x2051) { // Response
+            if (_scanned == nullptr) {
+                _onScanMissed();
+            } else {
+                _meter = std::move(_scanned);
+                _enterJoinState(JOIN_CHANNEL_SETTINGS);
+            }
         }
-        delay(1000);
+        return;
     }
 
-    M5.Display.fillScreen(BLACK);
-    M5.Display.setCursor(0, 0);
-    M5.Display.printf("Addr: %s, Channel: %d, Pan ID: %s\n",
-                      hexString(_meter->addr, sizeof(_meter->addr)).c_str(), _meter->channel,
-                      hexString(_meter->panId, sizeof(_meter->panId)).c_str());
-    Serial.printf("Addr: %s, Channel: %d, Pan ID: %s\n",
-                  hexString(_meter->addr, sizeof(_meter->addr)).c_str(), _meter->channel,
-                  hexString(_meter->panId, sizeof(_meter->panId)).c_str());
-
-    M5.Display.printf("Connecting");
-
-    // Setup
-    M5.Display.printf(".");
-    initialSettingsData[2] = _meter->channel;
-    _sendCommand(0x005f, initialSettingsData, sizeof(initialSettingsData)); // Initial settings
-    if (!_waitResponse(0x205f, &initialSettingsExpects, sizeof(initialSettingsExpects), 5000)) {
-        return false;
+    if (_joinExpectCommand == 0 || commandCode != _joinExpectCommand) {
+        return;
+    }
+    if (_joinExpectResult >= 0 && (dataLen < 1 || data[0] != _joinExpectResult)) {
+        _enterJoinState(JOIN_FAILED);
+        return;
+    }
+    if (_joinState == JOIN_UART_SETTINGS && (dataLen < 1 || data[0] != 0x01)) {
+        // refused: stay at the current baud rate
+        Serial.printf("WARN: Baud rate %u is refused\n", _targetBaudRate);
+        _baudRateFailed = true;
+        _enterJoinState(JOIN_INITIAL_SETTINGS);
+        return;
+    }
+    if (_joinState == JOIN_UART_VERIFY) {
+        Serial.printf("Baud rate: %u\n", _baudRate);
     }
+    if (_joinState == JOIN_INITIAL_SETTINGS) {
+        _meter = _joinUsingCache ? _loadSession() : nullptr;
+        _joinUsingCache = _meter != nullptr;
+        if (_joinUsingCache) {
+            // skip scan
+            _enterJoinState(JOIN_CHANNEL_SETTINGS);
+            return;
+        } else if (_connectMode == CONNECT_MODE_REJOIN) {
+            _enterJoinState(JOIN_FAILED);
+            return;
+        }
+        _setJoinPhase(JOIN_PHASE_SCANNING);
+    }
+    _enterJoinState((JoinState) (_joinState + 1));
+}
 
-    // Set B-route ID/password
-    M5.Display.printf(".");
-    struct {
-        uint8_t id[32];
-        uint8_t password[12];
-    } authData = {};
-    memcpy(authData.id, brouteId.c_str(), sizeof(authData.id));
-    memcpy(&authData.password, broutePassword.c_str(), sizeof(authData.password));
-    _sendCommand(0x0054, (uint8_t *) &authData, sizeof(authData)); // Set Route-B PANA Authentication Information
-    uint8_t authExpects = {0x01};
-    if (!_waitResponse(0x2054, &authExpects, sizeof(authExpects), 5000)) {
-        return false;
+/**
+ * Handle timer of join sequence
+ */
+void BP35C::_onJoinTimeout() {
+    switch (_joinState) {
+        case JOIN_RESET_PIN:
+        case JOIN_BOOT:
+            _enterJoinState((JoinState) (_joinState + 1));
+            break;
+        case JOIN_RESET:
+            if (_baudRate != DEFAULT_BAUD_RATE) {
+                // no reset notification at the switched baud rate: the module may have restarted at the default one
+                _updateBaudRate(DEFAULT_BAUD_RATE);
+                _enterJoinState(JOIN_VERSION);
+            } else {
+                _enterJoinState(JOIN_FAILED);
+            }
+            break;
+        case JOIN_UART_SETTINGS:
+        case JOIN_UART_VERIFY:
+            _onBaudRateFailed();
+            break;
+        case JOIN_SCAN:
+            _onScanMissed();
+            break;
+        case JOIN_SCAN_INTERVAL:
+            _enterJoinState(JOIN_SCAN);
+            break;
+        default:
+            _enterJoinState(JOIN_FAILED);
+            break;
     }
+}
 
-    // Initiate connection
-    M5.Display.printf(".");
-    _sendCommand(0x0053, nullptr, 0); // Initiate Route-B Operation
-    uint8_t initiateExpects = {0x01};
-    if (!_waitResponse(0x2053, &initiateExpects, sizeof(initiateExpects), 5000)) {
-        return false;
+/**
+ * Change baud rate of the UART on this side
+ *
+ * @param baudRate baud rate
+ */
+void BP35C::_updateBaudRate(uint32_t baudRate) {
+    if (baudRate == _baudRate) {
+        return;
     }
+    _serial.flush();
+    _serial.updateBaudRate(baudRate);
+    _baudRate = baudRate;
+    _linkQuality.setBaudRate(baudRate);
+    _flushInput();
+}
 
-    // Open UDP port
-    M5.Display.printf(".");
-    uint8_t openUdpData[] = {0x0e, 0x1a}; // port: 3610
-    _sendCommand(0x0005, openUdpData, sizeof(openUdpData)); // Open UDP Port
-    uint8_t openUdpExpects = {0x01};
-    if (!_waitResponse(0x2005, &openUdpExpects, sizeof(openUdpExpects), 5000)) {
-        return false;
+/**
+ * The module did not answer at the target baud rate: reset it back to the default baud rate
+ */
+void BP35C::_onBaudRateFailed() {
+    Serial.printf("ERROR: Failed to switch baud rate to %u. Falling back to %u\n",
+                  _targetBaudRate, DEFAULT_BAUD_RATE);
+    _baudRateFailed = true;
+    _enterJoinState(JOIN_RESET_PIN);
+}
+
+/**
+ * Scan again with longer duration, or give up
+ */
+void BP35C::_onScanMissed() {
+    if (_scanDuration >= 8) {
+        _enterJoinState(JOIN_FAILED);
+        return;
     }
+    _scanDuration++;
+    _enterJoinState(JOIN_SCAN_INTERVAL);
+}
 
-    // Authenticate
-    M5.Display.printf(".");
-    _sendCommand(0x0056, nullptr, 0); // Initiate Route-B PANA
-    uint8_t panaExpects = {0x01};
-    if (!_waitResponse(0x2056, &panaExpects, sizeof(panaExpects), 5000)) {
-        return false;
+/**
+ * MAC address of the connected smart meter
+ *
+ * @return MAC address (hex, empty if not connected)
+ */
+String BP35C::getMeterAddress() const {
+    if (_meter == nullptr) {
+        return "";
     }
-    if (!_waitResponse(0x6028, &panaExpects, sizeof(panaExpects), 5000)) {
-        // Received Notify PANA Authentication Result
-        return false;
+    return hexString(_meter->addr, sizeof(_meter->addr)).c_str();
+}
+
+/**
+ * Send PANA re-authentication command
+ *
+ * The result is notified by 0x6028 (Notify PANA Authentication Result).
+ */
+void BP35C::_startReauthentication() {
+    _sendCommand(0x0056); // Initiate Route-B PANA
+}
+
+/**
+ * Handle notification or response received while connected
+ *
+ * @param command received command
+ */
+void BP35C::_onNotification(const BP35CCommand &command) {
+    auto data = command.getData();
+    size_t dataLen = command.getDataLen();
+    auto commandCode = command.getCommandCode();
+    bool succeeded = dataLen >= 1 && data[0] == 0x01;
+    switch (commandCode) {
+        case 0x2056: // Response of Initiate Route-B PANA
+            if (!succeeded && getSessionState() == SESSION_REAUTHENTICATING) {
+                _setSessionState(SESSION_LOST);
+            }
+            break;
+        case 0x6028: // Notify PANA Authentication Result
+            if (succeeded) {
+                _setSessionState(SESSION_ESTABLISHED);
+            } else if (getSessionState() == SESSION_REAUTHENTICATING) {
+                _setSessionState(SESSION_LOST);
+            } else if (getSessionState() == SESSION_ESTABLISHED) {
+                // session ended by the meter
+                Serial.printf("PANA session ended (result=%02x)\n", dataLen >= 1 ? data[0] : 0);
+                reauthenticate();
+            }
+            break;
+        default:
+            break;
     }
+}
 
-    M5.Display.println("OK");
-    return true;
+/**
+ * Load the session of the last successful join
+ *
+ * @return meter (nullptr:not cached)
+ */
+std::unique_ptr<BP35CMeterEntry> BP35C::_loadSession() {
+    bp35c_session_t session{};
+    if (!nvsLoadBytes(SESSION_KEY, &session, sizeof(session))) {
+        return nullptr;
+    }
+    return std::make_unique<BP35CMeterEntry>(session.macAddress, session.panId, session.channel);
 }
 
 /**
- * Discard buffer
+ * Save the session of the successful join
  */
-void BP35C::_discardBuffer() {
-    delay(1000);
-    while (_serial.available()) {
-        _serial.read();
+void BP35C::_saveSession() {
+    bp35c_session_t session{};
+    memcpy(session.macAddress, _meter->addr, sizeof(session.macAddress));
+    memcpy(session.panId, _meter->panId, sizeof(session.panId));
+    session.channel = _meter->channel;
+    bp35c_session_t saved{};
+    if (nvsLoadBytes(SESSION_KEY, &saved, sizeof(saved)) && memcmp(&saved, &session, sizeof(session)) == 0) {
+        return;
     }
+    nvsSaveBytes(SESSION_KEY, &session, sizeof(session));
+}
+
+/**
+ * Discard received data
+ */
+void BP35C::_flushInput() {
+    _receiver.clear();
+    _parser.clear();
 }
 
 /**
@@ -204,32 +545,48 @@ void BP35C::_discardBuffer() {
  * @param dataLen data length
  */
 void BP35C::_sendCommand(uint16_t commandCode, const uint8_t *data, size_t dataLen) {
-    bp35c_command_header_t header = {
+    if (dataLen > MAX_TX_DATA_LENGTH) {
+        Serial.printf("ERROR: Command too long (%d bytes)\n", dataLen);
+        return;
+    }
+    if (dataLen > 0) {
+        memcpy(_txBuffer + BP35CCommand::HEADER_SIZE, data, dataLen);
+    }
+    _transmit(commandCode, dataLen);
+}
+
+/**
+ * Complete the header of the command in the TX buffer and send it with a single write
+ *
+ * @param commandCode command code
+ * @param dataLen data length (data is already in the TX buffer)
+ */
+void BP35C::_transmit(uint16_t commandCode, size_t dataLen) {
+    auto header = (bp35c_command_header_t *) _txBuffer;
+    auto data = _txBuffer + BP35CCommand::HEADER_SIZE;
+    *header = {
             .uniqueCode = {0xd0, 0xea, 0x83, 0xfc}, // Request: 0xD0EA83FC
             .commandCode = {(uint8_t) (commandCode >> 8), (uint8_t) (commandCode & 0xff)},
             .messageLength = {(uint8_t) ((4 + dataLen) >> 8), (uint8_t) ((4 + dataLen) & 0xff)},
     };
     uint16_t hSum = 0, dSum = 0;
-    for (int i = 0; i < 8; i++) hSum += *(((uint8_t *) &header) + i);
-    if (data != nullptr) {
-        for (int i = 0; i < dataLen; i++) dSum += *(data + i);
-    }
-    header.headerChecksum[0] = (uint8_t) (hSum >> 8);
-    header.headerChecksum[1] = (uint8_t) (hSum & 0xff);
-    header.dataChecksum[0] = (uint8_t) (dSum >> 8);
-    header.dataChecksum[1] = (uint8_t) (dSum & 0xff);
-
+    for (int i = 0; i < 8; i++) hSum += _txBuffer[i];
+    for (int i = 0; i < dataLen; i++) dSum += data[i];
+    header->headerChecksum[0] = (uint8_t) (hSum >> 8);
+    header->headerChecksum[1] = (uint8_t) (hSum & 0xff);
+    header->dataChecksum[0] = (uint8_t) (dSum >> 8);
+    header->dataChecksum[1] = (uint8_t) (dSum & 0xff);
+    _serial.write(_txBuffer, BP35CCommand::HEADER_SIZE + dataLen);
+    _linkQuality.onUart(BP35CCommand::HEADER_SIZE + dataLen);
+
+    // log after the command is handed to the UART
     Serial.printf("> %s %s %s %s %s %s\n",
-                  hexString((uint8_t *) header.uniqueCode, sizeof(header.uniqueCode)).c_str(),
-                  hexString((uint8_t *) header.commandCode, sizeof(header.commandCode)).c_str(),
-                  hexString((uint8_t *) header.messageLength, sizeof(header.messageLength)).c_str(),
-                  hexString((uint8_t *) header.headerChecksum, sizeof(header.headerChecksum)).c_str(),
-                  hexString((uint8_t *) header.dataChecksum, sizeof(header.dataChecksum)).c_str(),
+                  hexString(header->uniqueCode, sizeof(header->uniqueCode)).c_str(),
+                  hexString(header->commandCode, sizeof(header->commandCode)).c_str(),
+                  hexString(header->messageLength, sizeof(header->messageLength)).c_str(),
+                  hexString(header->headerChecksum, sizeof(header->headerChecksum)).c_str(),
+                  hexString(header->dataChecksum, sizeof(header->dataChecksum)).c_str(),
                   hexString(data, dataLen).c_str());
-    _serial.write((uint8_t *) &header, sizeof(header));
-    if (dataLen > 0) {
-        _serial.write(data, dataLen);
-    }
 }
 
 /**
@@ -238,92 +595,85 @@ void BP35C::_sendCommand(uint16_t commandCode, const uint8_t *data, size_t dataL
  * @return true:received, false:error or timeout
  */
 bool BP35C::_waitResponse(uint16_t cmd, const uint8_t *expect, size_t expectLen, int timeout) {
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto command = _readCommand(timeout - (int) (millis() - start));
-        if (command == nullptr) {
-            return false;
-        } else {
-            auto header = (bp35c_command_header_t *) command->data();
-            auto data = (uint8_t *) (header + 1);
-            if ((header->commandCode[0] << 8 | header->commandCode[1]) == cmd) {
-                return expect == nullptr || memcmp(data, expect, expectLen) == 0;
+    auto deadline = millis() + timeout;
+    BP35CCommand command;
+    while (_readCommand(command, deadline)) {
+        auto commandCode = command.getCommandCode();
+        if (commandCode == cmd) {
+            return expect == nullptr
+                   || (command.getDataLen() >= expectLen && memcmp(command.getData(), expect, expectLen) == 0);
+        } else if (commandCode == 0x6018) { // Notify Data Reception
+            // keep for receiveData()
+            auto received = _parseReceivedData(command);
+            if (received != nullptr) {
+                _received.push_back(std::move(received));
             }
+        } else {
+            _onNotification(command);
         }
     }
     return false;
 }
 
 /**
- * Read command
+ * Read a command if completely received
  *
- * @param timeout timeout (milliseconds)
- * @return response string (nullptr:timeout)
+ * Bytes received so far are fed to the parser without blocking.
+ *
+ * @param command received command (valid until the next call)
+ * @return true:received, false:not yet
  */
-std::unique_ptr<std::vector<uint8_t>> BP35C::_readCommand(int timeout) {
-    static uint8_t buf[256];
-    std::vector<uint8_t> ss;
-    auto start = millis();
-    size_t dataLen = 0;
-    size_t recvLen = 0;
-
-    // read header
-    while (millis() - start < timeout) {
-        auto len = _serial.readBytes(&buf[recvLen], sizeof(bp35c_command_header_t) - recvLen);
-        if (len == 0) {
-            continue;
-        }
-        recvLen += len;
-        if (recvLen >= sizeof(bp35c_command_header_t)) {
-            // find Response or Notification command
-            auto *p = (uint8_t *) buf;
-            while (!(*p == 0xd0 && *(p + 1) == 0xf9 && *(p + 2) == 0xee && *(p + 3) == 0x5d)) {
-                p++;
-                recvLen--;
-                if (recvLen < 4) {
-                    break;
-                }
+bool BP35C::_pollCommand(BP35CCommand &command) {
+    int c;
+    while ((c = _receiver.read()) >= 0) {
+        switch (_parser.push((uint8_t) c, command)) {
+            case BP35CParser::PARSE_COMMAND: {
+                auto frame = command.getFrame();
+                _linkQuality.onUart(command.getSize());
+                Serial.printf("< %s %s %s %s %s %s\n",
+                              hexString(frame, 4).c_str(), hexString(frame + 4, 2).c_str(),
+                              hexString(frame + 6, 2).c_str(), hexString(frame + 8, 2).c_str(),
+                              hexString(frame + 10, 2).c_str(),
+                              hexString(command.getData(), command.getDataLen()).c_str());
+                return true;
             }
-            if (p == buf) {
-                auto *header = (bp35c_command_header_t *) buf;
-                dataLen = (header->messageLength[0] << 8) + header->messageLength[1] - 4;
-                for (int i = 0; i < recvLen; i++) {
-                    ss.push_back(buf[i]);
-                }
+            case BP35CParser::PARSE_RESYNC:
+                Serial.println("WARNING: Discarded bytes before command");
+                _linkQuality.onResync();
+                break;
+            case BP35CParser::PARSE_HEADER_ERROR:
+                Serial.println("ERROR: Header checksum mismatch");
+                _linkQuality.onChecksumError();
+                break;
+            case BP35CParser::PARSE_DATA_ERROR:
+                Serial.println("ERROR: Data checksum mismatch");
+                _linkQuality.onChecksumError();
+                break;
+            case BP35CParser::PARSE_OVERFLOW:
+                Serial.println("ERROR: Command too long");
+                _linkQuality.onResync();
+                break;
+            default:
                 break;
-            }
-            memcpy(buf, p, recvLen);
-            continue;
         }
     }
+    return false;
+}
 
-    // read data
-    while (millis() - start < timeout) {
-        size_t restLen = (sizeof(bp35c_command_header_t) + dataLen) - recvLen;
-        if (restLen > 0) {
-            auto len = _serial.readBytes(buf, min(restLen, sizeof(buf)));
-            if (len == 0) {
-                continue;
-            }
-            for (int i = 0; i < len; i++) {
-                ss.push_back(buf[i]);
-                recvLen++;
-            }
-        }
-        if (recvLen >= sizeof(bp35c_command_header_t) + dataLen) {
-            auto header = (bp35c_command_header_t *) ss.data();
-            auto data = (uint8_t *) (header + 1);
-            Serial.printf("< %s %s %s %s %s %s\n",
-                          hexString((uint8_t *) header->uniqueCode, sizeof(header->uniqueCode)).c_str(),
-                          hexString((uint8_t *) header->commandCode, sizeof(header->commandCode)).c_str(),
-                          hexString((uint8_t *) header->messageLength, sizeof(header->messageLength)).c_str(),
-                          hexString((uint8_t *) header->headerChecksum, sizeof(header->headerChecksum)).c_str(),
-                          hexString((uint8_t *) header->dataChecksum, sizeof(header->dataChecksum)).c_str(),
-                          hexString(data, dataLen).c_str());
-            return std::make_unique<std::vector<uint8_t>>(ss);
+/**
+ * Read command
+ *
+ * @param command received command (valid until the next call)
+ * @param deadline deadline (millis)
+ * @return true:received, false:timeout
+ */
+bool BP35C::_readCommand(BP35CCommand &command, unsigned long deadline) {
+    do {
+        if (_pollCommand(command)) {
+            return true;
         }
-    }
-    return nullptr;
+    } while (_receiver.wait(deadline));
+    return false;
 }
 
 /**
@@ -334,18 +684,26 @@ std::unique_ptr<std::vector<uint8_t>> BP35C::_readCommand(int timeout) {
  * @param timeout timeout (milliseconds)
  */
 bool BP35C::sendData(const uint8_t *data, size_t dataLen, int timeout) {
-    uint8_t command[sizeof(bp35c_tx_request_header_t) + dataLen];
-    bp35c_tx_request_header_t header = {
+    if (_meter == nullptr) {
+        // not joined (scanning or failed to join)
+        return false;
+    }
+    if (sizeof(bp35c_tx_request_header_t) + dataLen > MAX_TX_DATA_LENGTH) {
+        Serial.printf("ERROR: Data too long (%d bytes)\n", dataLen);
+        return false;
+    }
+    // build the request in place in the TX buffer
+    auto header = (bp35c_tx_request_header_t *) (_txBuffer + BP35CCommand::HEADER_SIZE);
+    *header = {
             .destinationIPv6Address = {0xfe, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
             .sourcePort = {0x0e, 0x1a},
             .destinationPort = {0x0e, 0x1a},
             .transmissionDataSize = {(uint8_t) (dataLen >> 8), (uint8_t) (dataLen & 0xff)},
     };
-    memcpy(header.destinationIPv6Address + 8, _meter->addr, sizeof(_meter->addr));
-    header.destinationIPv6Address[8] ^= 0x02; // invert the lower 2nd bit of the first 1 byte of the MAC address.
-    memcpy(command, &header, sizeof(header));
-    memcpy(&command[sizeof(header)], data, dataLen);
-    _sendCommand(0x0008, command, sizeof(header) + dataLen); // Transmit Data
+    memcpy(header->destinationIPv6Address + 8, _meter->addr, sizeof(_meter->addr));
+    header->destinationIPv6Address[8] ^= 0x02; // invert the lower 2nd bit of the first 1 byte of the MAC address.
+    memcpy(header + 1, data, dataLen);
+    _transmit(0x0008, sizeof(*header) + dataLen); // Transmit Data
     uint8_t expects[] = {0x01, 0x00};
     return _waitResponse(0x2008, expects, sizeof(expects), timeout);
 }
@@ -357,55 +715,34 @@ bool BP35C::sendData(const uint8_t *data, size_t dataLen, int timeout) {
  * @return ECHONET Lite data (nullptr:failure)
  */
 std::unique_ptr<std::vector<uint8_t>> BP35C::receiveData(int timeout) {
-    auto result = std::make_unique<std::vector<uint8_t>>();
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto command = _readCommand(timeout - (int) (millis() - start));
-        if (command == nullptr) {
-            return nullptr;
-        } else {
-            auto header = (bp35c_command_header_t *) command->data();
-            auto data = (uint8_t *) (header + 1);
-            auto dataLen = (header->messageLength[0] << 8) + header->messageLength[1] - 4;
-            if ((header->commandCode[0] << 8 | header->commandCode[1]) == 0x6018) { // Notify Data Reception
-                for (int i = 27; i < dataLen; i++) {
-                    result->push_back(*(data + i));
-                }
-                return result;
-            }
+    if (!_received.empty()) {
+        auto result = std::move(_received.front());
+        _received.pop_front();
+        return result;
+    }
+    auto deadline = millis() + timeout;
+    BP35CCommand command;
+    while (_readCommand(command, deadline)) {
+        if (command.getCommandCode() == 0x6018) { // Notify Data Reception
+            return _parseReceivedData(command);
         }
+        _onNotification(command);
     }
     return nullptr;
 }
 
 /**
- * Receive scan result
+ * Parse Notify Data Reception
  *
- * @param timeout timeout (ms)
- * @return Scan result (nullptr:no entry or timeout)
+ * @param command received command
+ * @return ECHONET Lite data (nullptr:failure)
  */
-std::unique_ptr<BP35CMeterEntry> BP35C::_getScanResult(int timeout) {
-    std::unique_ptr<bp35c_scan_result_t> scanResult = nullptr;
-
-    auto start = millis();
-    while (millis() - start < timeout) {
-        auto command = _readCommand(timeout - (int) (millis() - start));
-        if (command == nullptr) {
-            continue;
-        } else {
-            auto header = (bp35c_command_header_t *) command->data();
-            auto data = (bp35c_scan_result_t *) (header + 1);
-            auto commandCode = (header->commandCode[0] << 8 | header->commandCode[1]);
-            if (commandCode == 0x4051 && data->scanResult == 0x00) { // Notification
-                scanResult = std::make_unique<bp35c_scan_result_t>(*data);
-            } else if (commandCode == 0x2051) { // Response
-                if (scanResult == nullptr) {
-                    return nullptr;
-                }
-                return std::make_unique<BP35CMeterEntry>(
-                        scanResult->macAddress, scanResult->panId, scanResult->channel);
-            }
-        }
+std::unique_ptr<std::vector<uint8_t>> BP35C::_parseReceivedData(const BP35CCommand &command) {
+    auto data = command.getData();
+    size_t dataLen = command.getDataLen();
+    if (dataLen < 27) {
+        return nullptr;
     }
-    return nullptr;
+    _linkQuality.onFrame((int8_t) data[24]); // RSSI (dBm)
+    return std::make_unique<std::vector<uint8_t>>(data + 27, data + dataLen);
 }
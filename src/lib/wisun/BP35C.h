@@ -1,6 +1,10 @@
 #if !defined(LIB_WISUN_BP35C_H)
 #define LIB_WISUN_BP35C_H
 
+#include <deque>
+
+#include "lib/wisun/BP35CParser.h"
+#include "lib/wisun/UartReceiver.h"
 #include "lib/wisun/WiSUN.h"
 
 /**
@@ -22,26 +26,147 @@ public:
  */
 class BP35C : public WiSUN {
 public:
-    explicit BP35C(const HardwareSerial &serial, int8_t rxPin, int8_t txPin)
+    explicit BP35C(HardwareSerial &serial, int8_t rxPin, int8_t txPin)
             : _serial(serial), _rxPin(rxPin), _txPin(txPin) {
-        _serial.begin(115200, SERIAL_8N1, _rxPin, _txPin);
+        // queue a whole command so that write() returns without waiting for the FIFO
+        _serial.setTxBufferSize(sizeof(_txBuffer));
+        _serial.setRxBufferSize(UartReceiver::RX_BUFFER_SIZE);
+        _serial.begin(DEFAULT_BAUD_RATE, SERIAL_8N1, _rxPin, _txPin);
+        _receiver.begin();
+        _linkQuality.setBaudRate(DEFAULT_BAUD_RATE);
     };
 
-    bool connect(const String &brouteId, const String &broutePassword) override;
+    void setBaudRate(uint32_t baudRate) override { _targetBaudRate = baudRate; }
+
+    bool probe();
+
+    void startConnect(const String &brouteId, const String &broutePassword, ConnectMode mode) override;
+
+    ConnectStatus pollConnect() override;
 
     bool sendData(const uint8_t *data, size_t dataLen, int timeout) override;
 
     std::unique_ptr<std::vector<uint8_t>> receiveData(int timeout) override;
 
+    String getMeterAddress() const override;
+
 private:
-    HardwareSerial _serial;
+    /**
+     * Join sequence
+     *
+     * Each state sends its command on entry and waits for the response or its timer.
+     */
+    typedef enum {
+        JOIN_IDLE = 0,
+        /// Hold the reset pin low
+        JOIN_RESET_PIN,
+        /// Wait for the module to boot
+        JOIN_BOOT,
+        JOIN_RESET,
+        JOIN_VERSION,
+        /// Switch the module to the target baud rate
+        JOIN_UART_SETTINGS,
+        /// Check the module answers at the target baud rate
+        JOIN_UART_VERIFY,
+        JOIN_INITIAL_SETTINGS,
+        JOIN_SCAN,
+        /// Wait before scanning with longer duration
+        JOIN_SCAN_INTERVAL,
+        JOIN_CHANNEL_SETTINGS,
+        JOIN_SET_AUTH,
+        JOIN_INITIATE,
+        JOIN_OPEN_UDP,
+        JOIN_PANA,
+        JOIN_PANA_RESULT,
+        JOIN_DONE,
+        JOIN_FAILED,
+    } JoinState;
+
+    /// Baud rate of the module after hardware reset
+    static const uint32_t DEFAULT_BAUD_RATE = 115200;
+
+    /// UART (by reference: a copy would delete the lock of the original on destruction)
+    HardwareSerial &_serial;
     int8_t _rxPin;
     int8_t _txPin;
 
+    /// Received bytes from the module
+    UartReceiver _receiver{_serial};
+
+    /// Current baud rate
+    uint32_t _baudRate = DEFAULT_BAUD_RATE;
+
+    /// Baud rate to switch to after reset
+    uint32_t _targetBaudRate = DEFAULT_BAUD_RATE;
+
+    /// Switching baud rate failed (stay at the default until reboot)
+    bool _baudRateFailed = false;
+
     /// Meter
     std::unique_ptr<BP35CMeterEntry> _meter;
 
-    void _discardBuffer();
+    /// Data received while waiting for command response
+    std::deque<std::unique_ptr<std::vector<uint8_t>>> _received;
+
+    /// Parser of received commands
+    BP35CParser _parser;
+
+    /// Maximum data length of a command to send
+    static const size_t MAX_TX_DATA_LENGTH = 1280;
+
+    /// Command being sent (header and data)
+    uint8_t _txBuffer[BP35CCommand::HEADER_SIZE + MAX_TX_DATA_LENGTH] = {};
+
+    /// State of join sequence
+    JoinState _joinState = JOIN_IDLE;
+
+    /// Timer of the current state
+    unsigned long _joinDeadline = 0;
+
+    /// Response expected in the current state (0: none)
+    uint16_t _joinExpectCommand = 0;
+
+    /// Result code expected in the response (-1: any)
+    int _joinExpectResult = -1;
+
+    String _brouteId;
+    String _broutePassword;
+
+    /// Mode of join sequence
+    ConnectMode _connectMode = CONNECT_MODE_BOOT;
+
+    /// Joining with the session cached in NVS
+    bool _joinUsingCache = false;
+
+    /// Scan duration
+    uint8_t _scanDuration = 0;
+
+    /// Scan result being received
+    std::unique_ptr<BP35CMeterEntry> _scanned;
+
+    void _startReauthentication() override;
+
+    void _onNotification(const BP35CCommand &command);
+
+    void _enterJoinState(JoinState state);
+
+    void _onJoinCommand(const BP35CCommand &command);
+
+    void _onJoinTimeout();
+
+    void _onScanMissed();
+
+    std::unique_ptr<BP35CMeterEntry> _loadSession();
+
+    void _saveSession();
+
+    void _sendInitialSettings(uint8_t channel);
+
+    void _updateBaudRate(uint32_t baudRate);
+
+    void _onBaudRateFailed();
+
+    void _flushInput();
 
     void _sendCommand(uint16_t commandCode, const uint8_t *data, size_t dataLen);
 
@@ -49,11 +174,15 @@ private:
         _sendCommand(cmd, nullptr, 0);
     }
 
+    void _transmit(uint16_t commandCode, size_t dataLen);
+
     bool _waitResponse(uint16_t cmd, const uint8_t *expect, size_t expectLen, int timeout);
 
-    std::unique_ptr<std::vector<uint8_t>> _readCommand(int timeout);
+    bool _pollCommand(BP35CCommand &command);
+
+    bool _readCommand(BP35CCommand &command, unsigned long deadline);
 
-    std::unique_ptr<BP35CMeterEntry> _getScanResult(int timeout);
+    std::unique_ptr<std::vector<uint8_t>> _parseReceivedData(const BP35CCommand &command);
 };
 
 #endif // !defined(LIB_WISUN_BP35C_H)
@@ -0,0 +1,123 @@
+#include "lib/wisun/BP35CParser.h"
+
+/// Unique code of Response or Notification: 0xD0F9EE5D
+static const uint8_t UNIQUE_CODE[] = {0xd0, 0xf9, 0xee, 0x5d};
+
+/**
+ * Parse a received byte
+ *
+ * @param c received byte
+ * @param command completed command (PARSE_COMMAND)
+ * @return result
+ */
+BP35CParser::Result BP35CParser::push(uint8_t c, BP35CCommand &command) {
+    switch (_state) {
+        case STATE_SYNC:
+            return _sync(c);
+        case STATE_HEADER:
+            _buffer[_len++] = c;
+            return _len < BP35CCommand::HEADER_SIZE ? PARSE_MORE : _onHeader(command);
+        case STATE_DATA:
+            _buffer[_len++] = c;
+            return _len < BP35CCommand::HEADER_SIZE + _dataLen ? PARSE_MORE : _onData(command);
+    }
+    return PARSE_MORE;
+}
+
+/**
+ * Discard the command being received
+ */
+void BP35CParser::clear() {
+    _state = STATE_SYNC;
+    _len = 0;
+    _discarding = false;
+}
+
+/**
+ * Match the unique code
+ *
+ * @param c received byte
+ * @return result
+ */
+BP35CParser::Result BP35CParser::_sync(uint8_t c) {
+    if (c != UNIQUE_CODE[_len]) {
+        // the unique code has no repeated prefix, so only its first byte can restart the match
+        _len = 0;
+        _discarding = true;
+        if (c != UNIQUE_CODE[0]) {
+            return PARSE_MORE;
+        }
+    }
+    _buffer[_len++] = c;
+    if (_len < sizeof(UNIQUE_CODE)) {
+        return PARSE_MORE;
+    }
+    _state = STATE_HEADER;
+    if (_discarding) {
+        _discarding = false;
+        _resyncs++;
+        return PARSE_RESYNC;
+    }
+    return PARSE_MORE;
+}
+
+/**
+ * Verify the header
+ *
+ * @return result
+ */
+BP35CParser::Result BP35CParser::_onHeader(BP35CCommand &command) {
+    uint16_t sum = 0;
+    for (size_t i = 0; i < 8; i++) {
+        sum += _buffer[i];
+    }
+    size_t messageLength = _buffer[6] << 8 | _buffer[7];
+    if (sum != (_buffer[8] << 8 | _buffer[9]) || messageLength < 4) {
+        _checksumErrors++;
+        // search the rest of the header for the unique code
+        uint8_t header[BP35CCommand::HEADER_SIZE];
+        for (size_t i = 0; i < BP35CCommand::HEADER_SIZE; i++) {
+            header[i] = _buffer[i];
+        }
+        _state = STATE_SYNC;
+        _len = 0;
+        _discarding = true;
+        BP35CCommand unused;
+        for (size_t i = 1; i < BP35CCommand::HEADER_SIZE; i++) {
+            // a whole command cannot fit in the rest of the header
+            push(header[i], unused);
+        }
+        return PARSE_HEADER_ERROR;
+    }
+    _dataLen = messageLength - 4;
+    if (_dataLen > MAX_DATA_LENGTH) {
+        _overflows++;
+        _state = STATE_SYNC;
+        _len = 0;
+        return PARSE_OVERFLOW;
+    }
+    _state = STATE_DATA;
+    return _dataLen > 0 ? PARSE_MORE : _onData(command);
+}
+
+/**
+ * Verify the data and complete the command
+ *
+ * @param command completed command
+ * @return result
+ */
+BP35CParser::Result BP35CParser::_onData(BP35CCommand &command) {
+    _state = STATE_SYNC;
+    auto size = _len;
+    _len = 0;
+    uint16_t sum = 0;
+    for (size_t i = BP35CCommand::HEADER_SIZE; i < size; i++) {
+        sum += _buffer[i];
+    }
+    if (sum != (_buffer[10] << 8 | _buffer[11])) {
+        _checksumErrors++;
+        return PARSE_DATA_ERROR;
+    }
+    command = BP35CCommand(_buffer, size);
+    return PARSE_COMMAND;
+}
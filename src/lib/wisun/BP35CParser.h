@@ -0,0 +1,109 @@
+#if !defined(LIB_WISUN_BP35C_PARSER_H)
+#define LIB_WISUN_BP35C_PARSER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Non-owning view of a command received from BP35C (header and data)
+ *
+ * Valid until the next byte is parsed.
+ */
+class BP35CCommand {
+public:
+    /// Unique code, command code, message length, header checksum, data checksum
+    static const size_t HEADER_SIZE = 12;
+
+    BP35CCommand() = default;
+
+    BP35CCommand(const uint8_t *frame, size_t size) : _frame(frame), _size(size) {};
+
+    /** Header and data */
+    const uint8_t *getFrame() const { return _frame; }
+
+    size_t getSize() const { return _size; }
+
+    uint16_t getCommandCode() const { return (uint16_t) (_frame[4] << 8 | _frame[5]); }
+
+    const uint8_t *getData() const { return _frame + HEADER_SIZE; }
+
+    size_t getDataLen() const { return _size - HEADER_SIZE; }
+
+private:
+    const uint8_t *_frame = nullptr;
+    size_t _size = 0;
+};
+
+/**
+ * Streaming parser of commands received from BP35C
+ *
+ * Bytes are fed one by one: the parser looks for the unique code, then collects the header and the data,
+ * verifying both checksums. A corrupted header is searched again for the unique code from its second byte,
+ * so that a command starting inside it is not lost. A command with corrupted data is dropped as a whole.
+ */
+class BP35CParser {
+public:
+    typedef enum {
+        /// Command is incomplete
+        PARSE_MORE = 0,
+        /// Command is completed
+        PARSE_COMMAND,
+        /// Bytes before the unique code were discarded
+        PARSE_RESYNC,
+        /// Header checksum mismatch (searching for the unique code again)
+        PARSE_HEADER_ERROR,
+        /// Data checksum mismatch (command dropped)
+        PARSE_DATA_ERROR,
+        /// Command is too long (dropped)
+        PARSE_OVERFLOW,
+    } Result;
+
+    /// Maximum data length of a command
+    static const size_t MAX_DATA_LENGTH = 1280;
+
+    Result push(uint8_t c, BP35CCommand &command);
+
+    void clear();
+
+    /// Times bytes were discarded to find the unique code
+    uint32_t getResyncs() const { return _resyncs; }
+
+    /// Commands with a corrupted header or data
+    uint32_t getChecksumErrors() const { return _checksumErrors; }
+
+    /// Commands too long to parse
+    uint32_t getOverflows() const { return _overflows; }
+
+private:
+    typedef enum {
+        STATE_SYNC = 0,
+        STATE_HEADER,
+        STATE_DATA,
+    } State;
+
+    State _state = STATE_SYNC;
+
+    /// Header and data of the command being received
+    uint8_t _buffer[BP35CCommand::HEADER_SIZE + MAX_DATA_LENGTH] = {};
+
+    /// Bytes in the buffer
+    size_t _len = 0;
+
+    /// Data length of the command being received
+    size_t _dataLen = 0;
+
+    /// Bytes have been discarded since the last unique code
+    bool _discarding = false;
+
+    uint32_t _resyncs = 0;
+    uint32_t _checksumErrors = 0;
+    uint32_t _overflows = 0;
+
+    Result _sync(uint8_t c);
+
+    Result _onHeader(BP35CCommand &command);
+
+    Result _onData(BP35CCommand &command);
+};
+
+#endif // !defined(LIB_WISUN_BP35C_PARSER_H)
@@ -0,0 +1,213 @@
+#if !defined(LIB_WISUN_LINE_FRAMER_H)
+#define LIB_WISUN_LINE_FRAMER_H
+
+#include <cstring>
+#include <Arduino.h>
+
+/**
+ * Non-owning view of a received line
+ *
+ * Valid until the next line is framed into the same buffer.
+ */
+class LineView {
+public:
+    LineView() = default;
+
+    LineView(const char *data, size_t len) : _data(data), _len(len) {};
+
+    const char *data() const { return _data; }
+
+    size_t length() const { return _len; }
+
+    bool isEmpty() const { return _len == 0; }
+
+    bool startsWith(const char *prefix) const {
+        auto n = strlen(prefix);
+        return n <= _len && memcmp(_data, prefix, n) == 0;
+    }
+
+    bool equals(const char *str) const {
+        return strlen(str) == _len && memcmp(_data, str, _len) == 0;
+    }
+
+    /**
+     * Find a string
+     *
+     * @param str string to find
+     * @return position (-1:not found)
+     */
+    int indexOf(const char *str) const {
+        auto n = strlen(str);
+        for (size_t i = 0; i + n <= _len; i++) {
+            if (memcmp(_data + i, str, n) == 0) {
+                return (int) i;
+            }
+        }
+        return -1;
+    }
+
+    /** Rest of the line from the position */
+    LineView substring(size_t from) const {
+        return from < _len ? LineView(_data + from, _len - from) : LineView(_data + _len, 0);
+    }
+
+    /** Line without leading and trailing spaces */
+    LineView trim() const {
+        size_t begin = 0, end = _len;
+        while (begin < end && _data[begin] == ' ') begin++;
+        while (end > begin && _data[end - 1] == ' ') end--;
+        return {_data + begin, end - begin};
+    }
+
+    /**
+     * Parse leading hex digits
+     *
+     * @return value (0 if no hex digit)
+     */
+    unsigned long toHex() const {
+        unsigned long value = 0;
+        for (size_t i = 0; i < _len && isxdigit(_data[i]); i++) {
+            value = (value << 4) | (isdigit(_data[i]) ? _data[i] - '0' : (_data[i] | 0x20) - 'a' + 10);
+        }
+        return value;
+    }
+
+    /**
+     * Copy to a NUL-terminated buffer
+     *
+     * @param buffer buffer
+     * @param size buffer size
+     * @return true:copied, false:too long (truncated)
+     */
+    bool copyTo(char *buffer, size_t size) const {
+        auto n = _len < size ? _len : size - 1;
+        memcpy(buffer, _data, n);
+        buffer[n] = '\0';
+        return n == _len;
+    }
+
+private:
+    const char *_data = "";
+    size_t _len = 0;
+};
+
+/**
+ * Space-separated tokens of a line (ERXUDP, EVENT)
+ */
+class LineTokenizer {
+public:
+    explicit LineTokenizer(const LineView &line) : _line(line) {};
+
+    /**
+     * Next token
+     *
+     * @param token token
+     * @return true:found, false:end of line
+     */
+    bool next(LineView &token) {
+        while (_pos < _line.length() && _line.data()[_pos] == ' ') _pos++;
+        if (_pos >= _line.length()) {
+            return false;
+        }
+        auto begin = _pos;
+        while (_pos < _line.length() && _line.data()[_pos] != ' ') _pos++;
+        token = LineView(_line.data() + begin, _pos - begin);
+        return true;
+    }
+
+    /**
+     * Skip tokens and get the next one
+     *
+     * @param count tokens to skip
+     * @param token token
+     * @return true:found, false:end of line
+     */
+    bool skip(int count, LineView &token) {
+        for (int i = 0; i < count; i++) {
+            if (!next(token)) {
+                return false;
+            }
+        }
+        return next(token);
+    }
+
+private:
+    LineView _line;
+    size_t _pos = 0;
+};
+
+/**
+ * Field "Key:Value" of EPANDESC
+ *
+ * @param line line
+ * @param key key (without indent)
+ * @param value value
+ * @return true:field, false:not a field
+ */
+inline bool parseLineField(const LineView &line, LineView &key, LineView &value) {
+    auto pos = line.indexOf(":");
+    if (pos < 0) {
+        return false;
+    }
+    key = LineView(line.data(), pos).trim();
+    value = line.substring(pos + 1).trim();
+    return true;
+}
+
+/**
+ * Frames lines (CRLF) into a fixed buffer without allocation
+ *
+ * @tparam SIZE maximum line length
+ */
+template<size_t SIZE>
+class LineFramer {
+public:
+    /**
+     * Add a received byte
+     *
+     * @param c received byte
+     * @param line completed line (without CRLF, valid until the next call)
+     * @return true:a non-empty line is completed
+     */
+    bool push(char c, LineView &line) {
+        if (c != '\n') {
+            if (_len < SIZE) {
+                _buffer[_len] = c;
+            }
+            _len++;
+            return false;
+        }
+        auto len = _len;
+        _len = 0;
+        if (len > SIZE) {
+            // too long: drop the whole line rather than passing a truncated one
+            _overflows++;
+            return false;
+        }
+        if (len > 0 && _buffer[len - 1] == '\r') {
+            len--;
+        }
+        if (len == 0) {
+            return false;
+        }
+        _buffer[len] = '\0';
+        line = LineView(_buffer, len);
+        return true;
+    }
+
+    /** Discard the partially received line */
+    void clear() { _len = 0; }
+
+    /** Lines dropped because they are too long */
+    uint32_t getOverflows() const { return _overflows; }
+
+private:
+    char _buffer[SIZE + 1] = {};
+
+    /// Length of the partially received line (may exceed SIZE)
+    size_t _len = 0;
+
+    uint32_t _overflows = 0;
+};
+
+#endif // !defined(LIB_WISUN_LINE_FRAMER_H)
@@ -0,0 +1,64 @@
+#include <Arduino.h>
+
+#include "lib/wisun/UartReceiver.h"
+
+/**
+ * Start receiving (call after HardwareSerial::begin)
+ */
+void UartReceiver::begin() {
+    // called when the FIFO fills as well as when the line goes idle (end of line or command),
+    // so that a long response (E2+E4 history: ~930 characters) is drained before the driver buffer overruns
+    _serial.onReceive([this] { _onReceive(); }, false);
+}
+
+/**
+ * Drain the UART into the ring buffer (UART event task)
+ */
+void UartReceiver::_onReceive() {
+    uint8_t chunk[128];
+    size_t n;
+    while ((n = _serial.read(chunk, min((size_t) _serial.available(), sizeof(chunk)))) > 0) {
+        auto written = _buffer.write(chunk, n);
+        _overflows += n - written;
+    }
+    xSemaphoreGive(_ready);
+}
+
+/**
+ * Wait until bytes are received
+ *
+ * @param deadline deadline (millis())
+ * @return true:received, false:deadline
+ */
+bool UartReceiver::wait(unsigned long deadline) {
+    while (_buffer.available() == 0) {
+        auto remaining = (long) (deadline - millis());
+        if (remaining <= 0) {
+            return false;
+        }
+        xSemaphoreTake(_ready, pdMS_TO_TICKS(remaining));
+    }
+    return true;
+}
+
+/**
+ * Read bytes, waiting until the deadline if none are received
+ *
+ * @param data buffer
+ * @param len buffer length
+ * @param deadline deadline (millis())
+ * @return bytes read (0:deadline)
+ */
+size_t UartReceiver::read(uint8_t *data, size_t len, unsigned long deadline) {
+    if (!wait(deadline)) {
+        return 0;
+    }
+    return _buffer.read(data, len);
+}
+
+/**
+ * Discard received bytes
+ */
+void UartReceiver::clear() {
+    _buffer.clear();
+}
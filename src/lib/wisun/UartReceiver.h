@@ -0,0 +1,61 @@
+#if !defined(LIB_WISUN_UART_RECEIVER_H)
+#define LIB_WISUN_UART_RECEIVER_H
+
+#include <Arduino.h>
+
+#include "lib/RingBuffer.h"
+
+/**
+ * Receiver of the UART to the Wi-SUN module
+ *
+ * Received bytes are drained into a ring buffer by the UART event task of HardwareSerial, which is woken by
+ * the UART driver whenever the FIFO fills as well as when the line goes idle (end of each line or command).
+ * The reader sleeps on a semaphore until then instead of polling the UART.
+ */
+class UartReceiver {
+public:
+    /// RX buffer of the UART driver (set by HardwareSerial::setRxBufferSize() before begin())
+    static const size_t RX_BUFFER_SIZE = 2048;
+
+    explicit UartReceiver(HardwareSerial &serial) : _serial(serial), _ready(xSemaphoreCreateBinary()) {};
+
+    ~UartReceiver() {
+        _serial.onReceive(nullptr);
+        vSemaphoreDelete(_ready);
+    }
+
+    void begin();
+
+    /** Bytes received (non-blocking) */
+    size_t available() const { return _buffer.available(); }
+
+    /** Read a byte (non-blocking, -1:empty) */
+    int read() { return _buffer.read(); }
+
+    size_t read(uint8_t *data, size_t len, unsigned long deadline);
+
+    bool wait(unsigned long deadline);
+
+    void clear();
+
+    /** Bytes lost because the ring buffer was full */
+    uint32_t getOverflows() const { return _overflows; }
+
+private:
+    /// Capacity of the ring buffer (the longest ERXUDP line is about 1 KB)
+    static const size_t BUFFER_SIZE = 4096;
+
+    HardwareSerial &_serial;
+
+    RingBuffer<BUFFER_SIZE> _buffer;
+
+    /// Given when bytes are received
+    SemaphoreHandle_t _ready;
+
+    /// Bytes lost because the ring buffer was full
+    uint32_t _overflows = 0;
+
+    void _onReceive();
+};
+
+#endif // !defined(LIB_WISUN_UART_RECEIVER_H)
@@ -1,16 +1,172 @@
 #if !defined(LIB_WISUN_H)
 #define LIB_WISUN_H
 
+#include <atomic>
+
+#include "lib/LinkQuality.h"
+
 class WiSUN {
 public:
-    /** Connect to smart meter */
-    virtual bool connect(const String &brouteId, const String &broutePassword) = 0;
+    typedef enum {
+        /// Join sequence is running
+        CONNECT_IN_PROGRESS = 0,
+        /// Joined to the smart meter
+        CONNECT_SUCCEEDED,
+        /// Failed to join
+        CONNECT_FAILED,
+    } ConnectStatus;
+
+    typedef enum {
+        /// Reset the module and join with the cached session first, scan if it fails
+        CONNECT_MODE_BOOT = 0,
+        /// Join with the cached session only (without resetting the module)
+        CONNECT_MODE_REJOIN,
+        /// Scan for the meter and join (without resetting the module)
+        CONNECT_MODE_RESCAN,
+    } ConnectMode;
+
+    /**
+     * Progress of join sequence to show (steps count up within a phase)
+     */
+    typedef enum {
+        JOIN_PHASE_NONE = 0,
+        /// Initializing the module
+        JOIN_PHASE_INITIALIZING,
+        /// Scanning for the meter
+        JOIN_PHASE_SCANNING,
+        /// Joining to the meter
+        JOIN_PHASE_CONNECTING,
+        JOIN_PHASE_SUCCEEDED,
+        JOIN_PHASE_FAILED,
+    } JoinPhase;
+
+    typedef enum {
+        /// Not joined
+        SESSION_NONE = 0,
+        /// PANA session is established
+        SESSION_ESTABLISHED,
+        /// Re-authenticating (expired, terminated by the meter or refreshed before expiry)
+        SESSION_REAUTHENTICATING,
+        /// Re-authentication failed (join again)
+        SESSION_LOST,
+    } SessionState;
+
+    /**
+     * Connect to smart meter (blocking)
+     *
+     * @return true:success, false:failure
+     */
+    virtual bool connect(const String &brouteId, const String &broutePassword) {
+        startConnect(brouteId, broutePassword, CONNECT_MODE_BOOT);
+        ConnectStatus status;
+        while ((status = pollConnect()) == CONNECT_IN_PROGRESS) {
+            delay(1);
+        }
+        return status == CONNECT_SUCCEEDED;
+    }
+
+    /** Start join sequence */
+    virtual void startConnect(const String &brouteId, const String &broutePassword, ConnectMode mode) = 0;
+
+    /** Advance join sequence by received data and timers without blocking */
+    virtual ConnectStatus pollConnect() = 0;
 
     /** Send ECHONET Lite data */
     virtual bool sendData(const uint8_t *data, size_t dataLen, int timeout) = 0;
 
     /** Receive ECHONET Lite data */
     virtual std::unique_ptr<std::vector<uint8_t>> receiveData(int timeout) = 0;
+
+    /** MAC address of the connected smart meter (hex, empty if not connected) */
+    virtual String getMeterAddress() const = 0;
+
+    /**
+     * Set baud rate of the UART to switch to after reset
+     *
+     * Not supported by default (the module stays at its default baud rate).
+     */
+    virtual void setBaudRate(uint32_t baudRate) {
+        Serial.printf("WARN: Baud rate %u is not supported\n", baudRate);
+    }
+
+    /** Link quality of received frames */
+    LinkQuality &getLinkQuality() { return _linkQuality; }
+
+    /** Phase of join sequence (readable from any task) */
+    JoinPhase getJoinPhase() const { return _joinPhase; }
+
+    /** Steps done in the current phase (readable from any task) */
+    int getJoinSteps() const { return _joinSteps; }
+
+    /** State of PANA session (updated while sending and receiving data) */
+    SessionState getSessionState() const { return _sessionState; }
+
+    /**
+     * Keep PANA session
+     *
+     * Re-authenticates before the session lifetime runs out, and gives up re-authentication without result.
+     * If the lifetime is unknown, the session is re-authenticated only after the meter ends it.
+     * Call periodically while connected.
+     */
+    void maintainSession() {
+        auto elapsed = millis() - _sessionChangedAt;
+        if (_sessionState == SESSION_ESTABLISHED && _sessionLifetime > 0 && elapsed >= _sessionLifetime / 10 * 9) {
+            Serial.println("PANA session is about to expire");
+            reauthenticate();
+        } else if (_sessionState == SESSION_REAUTHENTICATING && elapsed >= REAUTHENTICATION_TIMEOUT) {
+            Serial.println("ERROR: PANA re-authentication timed out");
+            _setSessionState(SESSION_LOST);
+        }
+    }
+
+    /** Start PANA re-authentication with the joined meter (without blocking) */
+    void reauthenticate() {
+        _setSessionState(SESSION_REAUTHENTICATING);
+        _startReauthentication();
+    }
+
+protected:
+    /// Timeout of PANA re-authentication (milliseconds)
+    static const unsigned long REAUTHENTICATION_TIMEOUT = 30000;
+
+    /**
+     * PANA session lifetime (milliseconds, 0 if unknown)
+     *
+     * BP35A reads it from register S16.
+     * BP35C does not report it (0x6028 carries only the result), so it stays unknown
+     * and the session is renewed when the meter ends it.
+     */
+    unsigned long _sessionLifetime = 0;
+
+    /// Link quality of received frames
+    LinkQuality _linkQuality;
+
+    /** Send re-authentication command */
+    virtual void _startReauthentication() = 0;
+
+    void _setJoinPhase(JoinPhase phase) {
+        _joinSteps = 0;
+        _joinPhase = phase;
+    }
+
+    void _onJoinStep() { _joinSteps++; }
+
+    void _setSessionState(SessionState state) {
+        if (state != _sessionState) {
+            Serial.printf("PANA session: %d -> %d\n", _sessionState, state);
+        }
+        _sessionState = state;
+        _sessionChangedAt = millis();
+    }
+
+private:
+    SessionState _sessionState = SESSION_NONE;
+
+    std::atomic<JoinPhase> _joinPhase{JOIN_PHASE_NONE};
+    std::atomic<int> _joinSteps{0};
+
+    /// Time of the last session state change
+    unsigned long _sessionChangedAt = 0;
 };
 
 #endif // !defined(LIB_WISUN_H)
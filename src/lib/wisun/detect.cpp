@@ -0,0 +1,134 @@
+#include <Arduino.h>
+
+#include "lib/wisun/detect.h"
+#include "lib/wisun/BP35A.h"
+#include "lib/wisun/BP35C.h"
+#include "lib/nvs.h"
+
+/// NVS key of detected module
+static const char *MODULE_KEY = "wisun.module";
+
+/**
+ * Module type
+ */
+typedef enum {
+    MODULE_BP35A = 0,
+    MODULE_BP35C,
+} wisun_module_type_t;
+
+/**
+ * Module and UART pins (cached in NVS)
+ *
+ * The baud rate is not part of it: the module always starts at its default baud rate after reset.
+ */
+typedef struct {
+    uint8_t type;
+    int8_t rxPin;
+    int8_t txPin;
+} __attribute__((packed)) wisun_module_t;
+
+/**
+ * Candidates in order of probing
+ *
+ * GPIO26 is the reset pin of BP35C, so BP35C is probed first without touching it,
+ * and the pin is made an input again before it is used as RX of BP35A.
+ */
+static const wisun_module_t CANDIDATES[] = {
+        {MODULE_BP35C, 36, 0},
+        {MODULE_BP35A, 26, 0},
+        // Wi-SUN HAT rev 0.1
+        {MODULE_BP35A, 36, 0},
+};
+
+/// Rounds of probing all candidates (the module may still be booting)
+static const int PROBE_ROUNDS = 3;
+
+static const char *moduleName(const wisun_module_t &module) {
+    return module.type == MODULE_BP35C ? "BP35C" : "BP35A";
+}
+
+/**
+ * Create driver of the module
+ *
+ * @param module module and UART parameters
+ * @param serial UART
+ * @param probe check if the module answers
+ * @return driver (nullptr:not answered)
+ */
+static std::unique_ptr<WiSUN> createModule(const wisun_module_t &module, HardwareSerial &serial, bool probe) {
+    if (module.type == MODULE_BP35C) {
+        auto bp35c = std::make_unique<BP35C>(serial, module.rxPin, module.txPin);
+        if (probe && !bp35c->probe()) {
+            return nullptr;
+        }
+        return bp35c;
+    } else {
+        auto bp35a = std::make_unique<BP35A>(serial, module.rxPin, module.txPin);
+        if (probe && !bp35a->probe()) {
+            return nullptr;
+        }
+        return bp35a;
+    }
+}
+
+/**
+ * Create driver of the module specified by name
+ *
+ * @param module "BP35A" or "BP35C"
+ * @param serial UART
+ * @return driver
+ */
+std::unique_ptr<WiSUN> wisunCreate(const String &module, HardwareSerial &serial) {
+    if (module == "BP35C") {
+        return createModule(CANDIDATES[0], serial, false);
+    } else {
+        // rxPin: Wi-SUN HAT rev 0.1 の場合は 36 にする
+        return createModule(CANDIDATES[1], serial, false);
+    }
+}
+
+/**
+ * Detect Wi-SUN module and create its driver
+ *
+ * The module detected once is cached in NVS and created without probing on later boots.
+ *
+ * @param serial UART
+ * @return driver (nullptr:not detected)
+ */
+std::unique_ptr<WiSUN> wisunDetect(HardwareSerial &serial) {
+    wisun_module_t cached{};
+    if (nvsLoadBytes(MODULE_KEY, &cached, sizeof(cached))
+        && (cached.type == MODULE_BP35A || cached.type == MODULE_BP35C)) {
+        Serial.printf("Wi-SUN module: %s (rx=%d, tx=%d, cached)\n", moduleName(cached), cached.rxPin, cached.txPin);
+        return createModule(cached, serial, false);
+    }
+
+    for (int round = 0; round < PROBE_ROUNDS; round++) {
+        for (const auto &candidate: CANDIDATES) {
+            Serial.printf("Probing %s (rx=%d, tx=%d)\n", moduleName(candidate), candidate.rxPin, candidate.txPin);
+            if (candidate.rxPin == 26) {
+                // GPIO26 may still be driven as the reset output of a BP35C driver created before
+                pinMode(26, INPUT);
+            }
+            auto wisun = createModule(candidate, serial, true);
+            if (wisun != nullptr) {
+                Serial.printf("Wi-SUN module: %s (rx=%d, tx=%d)\n",
+                              moduleName(candidate), candidate.rxPin, candidate.txPin);
+                nvsSaveBytes(MODULE_KEY, &candidate, sizeof(candidate));
+                return wisun;
+            }
+            // release the pins for the next candidate
+            serial.end();
+        }
+        delay(1000);
+    }
+    Serial.println("ERROR: Wi-SUN module not detected");
+    return nullptr;
+}
+
+/**
+ * Forget the detected module (probe again on next boot)
+ */
+void wisunForgetDetected() {
+    nvsRemove(MODULE_KEY);
+}
@@ -0,0 +1,15 @@
+#if !defined(LIB_WISUN_DETECT_H)
+#define LIB_WISUN_DETECT_H
+
+#include <memory>
+#include <Arduino.h>
+
+#include "lib/wisun/WiSUN.h"
+
+std::unique_ptr<WiSUN> wisunCreate(const String &module, HardwareSerial &serial);
+
+std::unique_ptr<WiSUN> wisunDetect(HardwareSerial &serial);
+
+void wisunForgetDetected();
+
+#endif // !defined(LIB_WISUN_DETECT_H)
@@ -0,0 +1,25 @@
+#if !defined(TEST_NATIVE_ARDUINO_H)
+#define TEST_NATIVE_ARDUINO_H
+
+#include <cstdarg>
+#include <cstdio>
+
+/**
+ * Minimal Arduino API for the native unit tests (serial log goes to stdout)
+ */
+class NativeSerial {
+public:
+    int printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+        va_list args;
+        va_start(args, format);
+        int n = vprintf(format, args);
+        va_end(args);
+        return n;
+    }
+
+    int println(const char *s) { return std::printf("%s\n", s); }
+};
+
+static NativeSerial Serial;
+
+#endif // !defined(TEST_NATIVE_ARDUINO_H)
@@ -0,0 +1,185 @@
+#include <vector>
+
+#include <unity.h>
+
+#include "lib/wisun/BP35CParser.h"
+
+/**
+ * Build a response or notification
+ *
+ * @param commandCode command code
+ * @param data data
+ * @return command with checksums
+ */
+static std::vector<uint8_t> makeCommand(uint16_t commandCode, const std::vector<uint8_t> &data) {
+    size_t messageLength = data.size() + 4;
+    std::vector<uint8_t> command = {
+            0xd0, 0xf9, 0xee, 0x5d,
+            (uint8_t) (commandCode >> 8), (uint8_t) commandCode,
+            (uint8_t) (messageLength >> 8), (uint8_t) messageLength,
+    };
+    uint16_t headerSum = 0;
+    for (auto c: command) {
+        headerSum += c;
+    }
+    uint16_t dataSum = 0;
+    for (auto c: data) {
+        dataSum += c;
+    }
+    command.push_back(headerSum >> 8);
+    command.push_back(headerSum);
+    command.push_back(dataSum >> 8);
+    command.push_back(dataSum);
+    command.insert(command.end(), data.begin(), data.end());
+    return command;
+}
+
+/**
+ * Feed bytes and collect results other than PARSE_MORE
+ */
+static std::vector<BP35CParser::Result> feed(BP35CParser &parser, const std::vector<uint8_t> &bytes,
+                                             std::vector<uint16_t> *commandCodes = nullptr) {
+    std::vector<BP35CParser::Result> results;
+    BP35CCommand command;
+    for (auto c: bytes) {
+        auto result = parser.push(c, command);
+        if (result == BP35CParser::PARSE_MORE) {
+            continue;
+        }
+        results.push_back(result);
+        if (result == BP35CParser::PARSE_COMMAND && commandCodes != nullptr) {
+            commandCodes->push_back(command.getCommandCode());
+        }
+    }
+    return results;
+}
+
+static void append(std::vector<uint8_t> &bytes, const std::vector<uint8_t> &more) {
+    bytes.insert(bytes.end(), more.begin(), more.end());
+}
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_command() {
+    BP35CParser parser;
+    auto bytes = makeCommand(0x6018, {0x01, 0x02, 0x03});
+    BP35CCommand command;
+    for (size_t i = 0; i + 1 < bytes.size(); i++) {
+        TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_MORE, parser.push(bytes[i], command));
+    }
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, parser.push(bytes.back(), command));
+    TEST_ASSERT_EQUAL_HEX16(0x6018, command.getCommandCode());
+    TEST_ASSERT_EQUAL_UINT(3, command.getDataLen());
+    TEST_ASSERT_EQUAL_UINT(bytes.size(), command.getSize());
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(bytes.data() + BP35CCommand::HEADER_SIZE, command.getData(), 3);
+    TEST_ASSERT_EQUAL_UINT32(0, parser.getResyncs());
+    TEST_ASSERT_EQUAL_UINT32(0, parser.getChecksumErrors());
+}
+
+void test_command_without_data() {
+    BP35CParser parser;
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, makeCommand(0x206b, {}), &codes);
+    TEST_ASSERT_EQUAL_UINT(1, results.size());
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, results[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x206b, codes[0]);
+}
+
+void test_resync() {
+    BP35CParser parser;
+    // garbage and a broken unique code before the command
+    std::vector<uint8_t> bytes = {0x01, 0xd0, 0xf9, 0x02, 0xd0, 0xd0};
+    append(bytes, makeCommand(0x2008, {0x01}));
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, bytes, &codes);
+    TEST_ASSERT_EQUAL_UINT(2, results.size());
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_RESYNC, results[0]);
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, results[1]);
+    TEST_ASSERT_EQUAL_HEX16(0x2008, codes[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getResyncs());
+}
+
+void test_header_checksum_error() {
+    BP35CParser parser;
+    auto broken = makeCommand(0x206b, {0x01});
+    broken[9] ^= 0x01;
+    std::vector<uint8_t> bytes = broken;
+    append(bytes, makeCommand(0x2008, {0x01}));
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, bytes, &codes);
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_HEADER_ERROR, results.front());
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, results.back());
+    TEST_ASSERT_EQUAL_UINT(1, codes.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2008, codes[0]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getChecksumErrors());
+}
+
+void test_command_inside_broken_header() {
+    BP35CParser parser;
+    // a lone unique code: its "header" swallows the start of the next command
+    std::vector<uint8_t> bytes = {0xd0, 0xf9, 0xee, 0x5d};
+    append(bytes, makeCommand(0x6018, {0x01, 0x02}));
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, bytes, &codes);
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_HEADER_ERROR, results.front());
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, results.back());
+    TEST_ASSERT_EQUAL_UINT(1, codes.size());
+    TEST_ASSERT_EQUAL_HEX16(0x6018, codes[0]);
+}
+
+void test_data_checksum_error() {
+    BP35CParser parser;
+    auto broken = makeCommand(0x6018, {0x01, 0x02, 0x03});
+    broken[BP35CCommand::HEADER_SIZE + 1] ^= 0x01;
+    std::vector<uint8_t> bytes = broken;
+    append(bytes, makeCommand(0x6018, {0x04}));
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, bytes, &codes);
+    TEST_ASSERT_EQUAL_UINT(2, results.size());
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_DATA_ERROR, results[0]);
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_COMMAND, results[1]);
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getChecksumErrors());
+    TEST_ASSERT_EQUAL_UINT32(0, parser.getResyncs());
+}
+
+void test_overflow() {
+    BP35CParser parser;
+    std::vector<uint8_t> data(BP35CParser::MAX_DATA_LENGTH + 1);
+    auto results = feed(parser, makeCommand(0x6018, data));
+    TEST_ASSERT_EQUAL_INT(BP35CParser::PARSE_OVERFLOW, results.front());
+    TEST_ASSERT_EQUAL_UINT32(1, parser.getOverflows());
+
+    // the largest command still fits
+    BP35CParser large;
+    data.pop_back();
+    std::vector<uint16_t> codes;
+    results = feed(large, makeCommand(0x6018, data), &codes);
+    TEST_ASSERT_EQUAL_UINT(1, codes.size());
+}
+
+void test_clear() {
+    BP35CParser parser;
+    auto first = makeCommand(0x6018, {0x01, 0x02});
+    first.resize(first.size() - 1);
+    feed(parser, first);
+    parser.clear();
+    std::vector<uint16_t> codes;
+    auto results = feed(parser, makeCommand(0x2008, {0x01}), &codes);
+    TEST_ASSERT_EQUAL_UINT(1, results.size());
+    TEST_ASSERT_EQUAL_HEX16(0x2008, codes[0]);
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_command);
+    RUN_TEST(test_command_without_data);
+    RUN_TEST(test_resync);
+    RUN_TEST(test_header_checksum_error);
+    RUN_TEST(test_command_inside_broken_header);
+    RUN_TEST(test_data_checksum_error);
+    RUN_TEST(test_overflow);
+    RUN_TEST(test_clear);
+    return UNITY_END();
+}
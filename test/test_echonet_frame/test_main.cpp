@@ -0,0 +1,102 @@
+#include <cstring>
+
+#include <unity.h>
+
+#include "lib/echonet/EchonetLiteFrame.h"
+
+/// Get_Res from the smart meter: E7 (4 bytes) and E1 (1 byte)
+static const uint8_t GET_RES[] = {
+        0x10, 0x81, 0x12, 0x34, 0x02, 0x88, 0x01, 0x05, 0xff, 0x01, 0x72, 0x02,
+        0xe7, 0x04, 0x00, 0x00, 0x01, 0xf4,
+        0xe1, 0x01, 0x01,
+};
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_header() {
+    EchonetLiteFrame frame(GET_RES, sizeof(GET_RES));
+    TEST_ASSERT_TRUE(frame.isValid());
+    TEST_ASSERT_EQUAL_HEX16(0x1234, frame.getTid());
+    TEST_ASSERT_EQUAL_HEX32(0x028801, frame.getSeoj());
+    TEST_ASSERT_EQUAL_HEX32(0x05ff01, frame.getDeoj());
+    TEST_ASSERT_EQUAL_UINT8(0x72, frame.getEsv());
+    TEST_ASSERT_EQUAL_UINT8(2, frame.getOpc());
+}
+
+void test_properties() {
+    EchonetLiteFrame frame(GET_RES, sizeof(GET_RES));
+    int count = 0;
+    for (auto prop: frame) {
+        TEST_ASSERT_EQUAL_UINT8(count == 0 ? 0xe7 : 0xe1, prop.epc);
+        count++;
+    }
+    TEST_ASSERT_EQUAL_INT(2, count);
+
+    EchonetLiteProperty prop{};
+    TEST_ASSERT_TRUE(frame.find(0xe7, prop));
+    TEST_ASSERT_EQUAL_UINT8(4, prop.pdc);
+    TEST_ASSERT_EQUAL_PTR(GET_RES + 14, prop.edt);
+    TEST_ASSERT_FALSE(frame.find(0xe0, prop));
+}
+
+void test_short_header() {
+    EchonetLiteFrame frame(GET_RES, EchonetLiteFrame::HEADER_SIZE - 1);
+    TEST_ASSERT_FALSE(frame.isValid());
+    TEST_ASSERT_EQUAL_UINT8(0, frame.getOpc());
+    TEST_ASSERT_FALSE(frame.begin() != frame.end());
+}
+
+void test_wrong_ehd() {
+    uint8_t data[sizeof(GET_RES)];
+    memcpy(data, GET_RES, sizeof(data));
+    data[1] = 0x82; // arbitrary message format
+    TEST_ASSERT_FALSE(EchonetLiteFrame(data, sizeof(data)).isValid());
+    data[1] = 0x81;
+    data[0] = 0x11;
+    TEST_ASSERT_FALSE(EchonetLiteFrame(data, sizeof(data)).isValid());
+}
+
+void test_truncated_edt() {
+    // last property declares 1 byte of EDT but the frame ends before it
+    EchonetLiteFrame frame(GET_RES, sizeof(GET_RES) - 1);
+    TEST_ASSERT_FALSE(frame.isValid());
+    EchonetLiteProperty prop{};
+    TEST_ASSERT_FALSE(frame.find(0xe7, prop));
+}
+
+void test_truncated_property() {
+    // frame ends between EPC and PDC
+    EchonetLiteFrame frame(GET_RES, sizeof(GET_RES) - 2);
+    TEST_ASSERT_FALSE(frame.isValid());
+}
+
+void test_opc_exceeds_properties() {
+    uint8_t data[sizeof(GET_RES)];
+    memcpy(data, GET_RES, sizeof(data));
+    data[11] = 3;
+    TEST_ASSERT_FALSE(EchonetLiteFrame(data, sizeof(data)).isValid());
+}
+
+void test_no_properties() {
+    uint8_t data[EchonetLiteFrame::HEADER_SIZE];
+    memcpy(data, GET_RES, sizeof(data));
+    data[11] = 0;
+    EchonetLiteFrame frame(data, sizeof(data));
+    TEST_ASSERT_TRUE(frame.isValid());
+    TEST_ASSERT_FALSE(frame.begin() != frame.end());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_header);
+    RUN_TEST(test_properties);
+    RUN_TEST(test_short_header);
+    RUN_TEST(test_wrong_ehd);
+    RUN_TEST(test_truncated_edt);
+    RUN_TEST(test_truncated_property);
+    RUN_TEST(test_opc_exceeds_properties);
+    RUN_TEST(test_no_properties);
+    return UNITY_END();
+}
@@ -0,0 +1,113 @@
+#include <cstdio>
+
+#include <unity.h>
+
+#include "lib/hex.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_encode() {
+    const uint8_t data[] = {0x10, 0x81, 0x00, 0x01, 0x05, 0xff, 0x01, 0x02, 0x88, 0x01, 0x62, 0x01, 0xe7, 0x00};
+    char hex[sizeof(data) * 2];
+    TEST_ASSERT_EQUAL_UINT(sizeof(hex), hexEncode(data, sizeof(data), hex));
+    TEST_ASSERT_EQUAL_STRING_LEN("1081000105ff010288016201e700", hex, sizeof(hex));
+    hexEncode(data, sizeof(data), hex, true);
+    TEST_ASSERT_EQUAL_STRING_LEN("1081000105FF010288016201E700", hex, sizeof(hex));
+}
+
+void test_encode_all_bytes() {
+    uint8_t data[256];
+    for (int i = 0; i < 256; i++) {
+        data[i] = (uint8_t) i;
+    }
+    char hex[sizeof(data) * 2];
+    hexEncode(data, sizeof(data), hex);
+    for (int i = 0; i < 256; i++) {
+        char expected[3];
+        snprintf(expected, sizeof(expected), "%02x", i);
+        TEST_ASSERT_EQUAL_STRING_LEN(expected, hex + i * 2, 2);
+    }
+}
+
+void test_encode_odd_length() {
+    // last step holds a single byte: nothing is written past the end
+    const uint8_t data[] = {0xab, 0xcd, 0xef};
+    char hex[8] = {0, 0, 0, 0, 0, 0, '#', '#'};
+    TEST_ASSERT_EQUAL_UINT(6, hexEncode(data, sizeof(data), hex));
+    TEST_ASSERT_EQUAL_STRING_LEN("abcdef##", hex, sizeof(hex));
+}
+
+void test_decode() {
+    const uint8_t expected[] = {0x10, 0x81, 0xab, 0xcd, 0xef};
+    uint8_t data[8];
+    TEST_ASSERT_EQUAL_INT(5, hexDecode("1081ABcdEf", 10, data, sizeof(data)));
+    TEST_ASSERT_EQUAL_HEX8_ARRAY(expected, data, sizeof(expected));
+    TEST_ASSERT_EQUAL_INT(0, hexDecode("", 0, data, sizeof(data)));
+}
+
+void test_decode_all_bytes() {
+    for (int i = 0; i < 256; i++) {
+        char lower[3], upper[3];
+        snprintf(lower, sizeof(lower), "%02x", i);
+        snprintf(upper, sizeof(upper), "%02X", i);
+        uint8_t data = 0;
+        TEST_ASSERT_EQUAL_INT(1, hexDecode(lower, 2, &data, 1));
+        TEST_ASSERT_EQUAL_UINT8(i, data);
+        data = 0;
+        TEST_ASSERT_EQUAL_INT(1, hexDecode(upper, 2, &data, 1));
+        TEST_ASSERT_EQUAL_UINT8(i, data);
+    }
+}
+
+void test_decode_invalid_digit() {
+    // every character that is not a hex digit, at each position of a word and of the last byte
+    for (int c = 0; c < 256; c++) {
+        bool isDigit = (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        if (isDigit) {
+            continue;
+        }
+        for (int pos = 0; pos < 6; pos++) {
+            char hex[] = "012345";
+            hex[pos] = (char) c;
+            uint8_t data[3];
+            TEST_ASSERT_EQUAL_INT(-1, hexDecode(hex, 6, data, sizeof(data)));
+        }
+    }
+}
+
+void test_decode_length() {
+    uint8_t data[2];
+    // odd number of digits
+    TEST_ASSERT_EQUAL_INT(-1, hexDecode("123", 3, data, sizeof(data)));
+    // output too small
+    TEST_ASSERT_EQUAL_INT(-1, hexDecode("123456", 6, data, sizeof(data)));
+}
+
+void test_round_trip() {
+    uint8_t data[37];
+    for (size_t i = 0; i < sizeof(data); i++) {
+        data[i] = (uint8_t) (i * 97 + 13);
+    }
+    for (size_t len = 0; len <= sizeof(data); len++) {
+        char hex[sizeof(data) * 2];
+        uint8_t decoded[sizeof(data)];
+        hexEncode(data, len, hex, len % 2 == 0);
+        TEST_ASSERT_EQUAL_INT((int) len, hexDecode(hex, len * 2, decoded, sizeof(decoded)));
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(data, decoded, len);
+    }
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_encode);
+    RUN_TEST(test_encode_all_bytes);
+    RUN_TEST(test_encode_odd_length);
+    RUN_TEST(test_decode);
+    RUN_TEST(test_decode_all_bytes);
+    RUN_TEST(test_decode_invalid_digit);
+    RUN_TEST(test_decode_length);
+    RUN_TEST(test_round_trip);
+    return UNITY_END();
+}
@@ -0,0 +1,100 @@
+#include <unity.h>
+
+#include "lib/LinkRecovery.h"
+
+void setUp() {}
+
+void tearDown() {}
+
+/**
+ * Fail and take the action at once
+ */
+static LinkRecovery::Action failAndPoll(LinkRecovery &recovery, unsigned long now,
+                                        LinkRecovery::Action atLeast = LinkRecovery::ACTION_RETRY) {
+    recovery.onFailure(now, atLeast);
+    return recovery.poll(now);
+}
+
+void test_nothing_to_do() {
+    LinkRecovery recovery;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.poll(1000));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.getRung());
+}
+
+void test_ladder() {
+    LinkRecovery recovery;
+    unsigned long now = 1000;
+    for (int i = 0; i < 3; i++) {
+        TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RETRY, failAndPoll(recovery, now));
+    }
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REAUTHENTICATE, failAndPoll(recovery, now));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, failAndPoll(recovery, now));
+    now += 5000;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, failAndPoll(recovery, now));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RESCAN, failAndPoll(recovery, now));
+    now += 30000;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RESCAN, failAndPoll(recovery, now));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RESET_MODULE, failAndPoll(recovery, now));
+    now += 60000;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RESET_MODULE, failAndPoll(recovery, now));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REBOOT, failAndPoll(recovery, now));
+    // top of the ladder
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REBOOT, failAndPoll(recovery, now));
+}
+
+void test_interval() {
+    LinkRecovery recovery;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, failAndPoll(recovery, 1000, LinkRecovery::ACTION_REJOIN));
+
+    // second rejoin waits 5 seconds from the first one
+    recovery.onFailure(2000);
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.poll(5999));
+    // failures while an action is pending do not climb the ladder
+    recovery.onFailure(3000);
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, recovery.poll(6000));
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.poll(6000));
+    TEST_ASSERT_EQUAL_INT(2, recovery.getTotal(LinkRecovery::ACTION_REJOIN));
+}
+
+void test_at_least() {
+    LinkRecovery recovery;
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RETRY, failAndPoll(recovery, 1000));
+    // lost session cannot be fixed by a retry
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, failAndPoll(recovery, 1000, LinkRecovery::ACTION_REJOIN));
+    // a lower floor does not bring the ladder down
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REJOIN, failAndPoll(recovery, 6000));
+}
+
+void test_success_resets() {
+    LinkRecovery recovery;
+    for (int i = 0; i < 4; i++) {
+        failAndPoll(recovery, 1000);
+    }
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_REAUTHENTICATE, recovery.getRung());
+
+    recovery.onSuccess();
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.getRung());
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_RETRY, failAndPoll(recovery, 2000));
+    // totals are kept since boot
+    TEST_ASSERT_EQUAL_INT(4, recovery.getTotal(LinkRecovery::ACTION_RETRY));
+    TEST_ASSERT_EQUAL_INT(1, recovery.getTotal(LinkRecovery::ACTION_REAUTHENTICATE));
+}
+
+void test_success_cancels_pending() {
+    LinkRecovery recovery;
+    failAndPoll(recovery, 1000, LinkRecovery::ACTION_REJOIN);
+    recovery.onFailure(2000);
+    recovery.onSuccess();
+    TEST_ASSERT_EQUAL_INT(LinkRecovery::ACTION_NONE, recovery.poll(10000));
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_nothing_to_do);
+    RUN_TEST(test_ladder);
+    RUN_TEST(test_interval);
+    RUN_TEST(test_at_least);
+    RUN_TEST(test_success_resets);
+    RUN_TEST(test_success_cancels_pending);
+    return UNITY_END();
+}
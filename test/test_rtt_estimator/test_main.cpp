@@ -0,0 +1,84 @@
+#include <unity.h>
+
+#include "lib/RttEstimator.h"
+
+static const int MIN_TIMEOUT = 1000;
+static const int MAX_TIMEOUT = 20000;
+
+void setUp() {}
+
+void tearDown() {}
+
+void test_no_sample() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    TEST_ASSERT_EQUAL_INT(MAX_TIMEOUT, rtt.getTimeout());
+    rtt.backoff();
+    TEST_ASSERT_EQUAL_INT(MAX_TIMEOUT, rtt.getTimeout());
+}
+
+void test_first_sample() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    rtt.update(2000);
+    TEST_ASSERT_EQUAL_INT(2000, rtt.getSmoothedRtt());
+    TEST_ASSERT_EQUAL_INT(1000, rtt.getRttVariance());
+    // SRTT + 4 * RTTVAR
+    TEST_ASSERT_EQUAL_INT(6000, rtt.getTimeout());
+}
+
+void test_smoothing() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    rtt.update(2000);
+    rtt.update(2000);
+    TEST_ASSERT_EQUAL_INT(2000, rtt.getSmoothedRtt());
+    TEST_ASSERT_EQUAL_INT(750, rtt.getRttVariance());
+    rtt.update(4000);
+    TEST_ASSERT_EQUAL_INT(2250, rtt.getSmoothedRtt());
+    TEST_ASSERT_EQUAL_INT(1062, rtt.getRttVariance());
+}
+
+void test_bounds() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    rtt.update(100);
+    TEST_ASSERT_EQUAL_INT(MIN_TIMEOUT, rtt.getTimeout());
+
+    RttEstimator slow(MIN_TIMEOUT, MAX_TIMEOUT);
+    slow.update(10000);
+    TEST_ASSERT_EQUAL_INT(MAX_TIMEOUT, slow.getTimeout());
+}
+
+void test_backoff_doubles_up_to_max() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    rtt.update(2000);
+    rtt.backoff();
+    TEST_ASSERT_EQUAL_INT(12000, rtt.getTimeout());
+    rtt.backoff();
+    TEST_ASSERT_EQUAL_INT(MAX_TIMEOUT, rtt.getTimeout());
+    rtt.backoff();
+    TEST_ASSERT_EQUAL_INT(MAX_TIMEOUT, rtt.getTimeout());
+}
+
+/**
+ * Karn's algorithm: the backed-off timeout is kept until a request answered without retransmission is sampled
+ */
+void test_backoff_kept_until_sample() {
+    RttEstimator rtt(MIN_TIMEOUT, MAX_TIMEOUT);
+    rtt.update(2000);
+    rtt.backoff();
+    // responses to retransmitted requests are not sampled, so nothing resets the backoff
+    TEST_ASSERT_EQUAL_INT(12000, rtt.getTimeout());
+    TEST_ASSERT_EQUAL_INT(2000, rtt.getSmoothedRtt());
+
+    rtt.update(2000);
+    TEST_ASSERT_EQUAL_INT(5000, rtt.getTimeout());
+}
+
+int main() {
+    UNITY_BEGIN();
+    RUN_TEST(test_no_sample);
+    RUN_TEST(test_first_sample);
+    RUN_TEST(test_smoothing);
+    RUN_TEST(test_bounds);
+    RUN_TEST(test_backoff_doubles_up_to_max);
+    RUN_TEST(test_backoff_kept_until_sample);
+    return UNITY_END();
+}